@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2017 David McKelvie.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __FAST_PIN_H__
+#define __FAST_PIN_H__
+
+#include <stdint.h>
+
+#ifdef NATIVE_HAL
+#include <NativeHal.h>
+#else
+// every store to a GPIO register goes through here, the host build records them
+#define PORT_WRITE(reg, value)  (*(reg) = (value))
+#endif
+
+#define GPIO_PORT_BASE      0x40010800UL    // GPIOA, ports are 0x400 apart
+#define GPIO_PORT_STRIDE    0x400UL
+#define GPIO_BSRR_OFFSET    0x10UL
+
+/**
+ * A pin resolved to its port and bit at compile time, writes go straight to
+ * the port's set/reset register.
+ *
+ * Pin numbers follow the generic STM32F103C board: PA0-PA15 are 0-15,
+ * PB0-PB15 are 16-31 and PC13-PC15 are 32-34.
+ */
+template <uint8_t Pin>
+struct FastPin {
+    static_assert(Pin <= 34, "not a generic STM32F103C pin");
+
+    static const uint32_t port = GPIO_PORT_BASE + (Pin < 32 ? Pin / 16 : 2) * GPIO_PORT_STRIDE;
+    static const uint8_t  bit = Pin < 32 ? Pin % 16 : Pin - 32 + 13;
+    static const uint32_t mask = 1UL << bit;
+
+    static inline volatile uint32_t &bsrr()
+    {
+        return *(volatile uint32_t *)(port + GPIO_BSRR_OFFSET);
+    }
+
+    /**
+     * BSRR word driving the pin to level, combine words for pins on the same port
+     */
+    static inline uint32_t word(uint8_t level)
+    {
+        return level ? mask : mask << 16;
+    }
+
+    static inline void write(uint8_t level)
+    {
+        PORT_WRITE(&bsrr(), word(level));
+    }
+
+    static inline void high()
+    {
+        PORT_WRITE(&bsrr(), mask);
+    }
+
+    static inline void low()
+    {
+        PORT_WRITE(&bsrr(), mask << 16);
+    }
+};
+
+#endif
@@ -19,7 +19,9 @@
  */
 
 #include "LEDMatrix.h"
+#include "Profile.h"
 #include "Arduino.h"
+#include <string.h>
 
 #if 0
 #define ASSERT(e)   if (!(e)) { Serial.println(#e); while (1); }
@@ -28,6 +30,14 @@
 #endif
 
 #define MODULE_HEIGHT	(32)
+#define ALL_ROWS        (0xffffffffUL)
+#define PIXEL_UPPER     0x08            // pixel buffer: upper colour in bits 0-2 is set
+#define PIXEL_LOWER     0x80            // lower colour in bits 4-6 is set
+
+LEDMatrix MatrixBuilder::create()
+{
+    return LEDMatrix(_a, _b, _c, _d, _oe, _lat, _clk, _r1, _r2, _g1, _g2, _b1, _b2);
+}
 
 LEDMatrix::LEDMatrix(uint8_t a, uint8_t b, uint8_t c, uint8_t d, uint8_t oe, uint8_t r1, uint8_t r2, uint8_t stb, uint8_t clk)
 {
@@ -40,9 +50,29 @@ LEDMatrix::LEDMatrix(uint8_t a, uint8_t b, uint8_t c, uint8_t d, uint8_t oe, uin
     this->b = b;
     this->c = c;
     this->d = d;
+    this->g1 = NO_PIN;
+    this->g2 = NO_PIN;
+    this->b1 = NO_PIN;
+    this->b2 = NO_PIN;
 
+    foreground = COLOUR_RED;
+    background = COLOUR_BLACK;
     mask = 0xff;
     state = 0;
+    dirty = 0;
+    swapped = 0;
+    rowCount = 0;
+    scanbuf = 0;
+    backScanbuf = 0;
+    blank = 0;
+    backBlank = 0;
+    swapPending = 0;
+    depth = 1;
+    pixels = 0;
+    pixelRows = 0;
+    scanRow = 0;
+    encoder = 0;
+    page = 0;
 }
 
 LEDMatrix::LEDMatrix(uint8_t a, uint8_t b, uint8_t c, uint8_t d, uint8_t oe, uint8_t stb, uint8_t clk, uint8_t r1, uint8_t r2,
@@ -62,8 +92,24 @@ uint8_t g1, uint8_t g2, uint8_t b1, uint8_t b2)
   this->c = c;
   this->d = d;
 
+  foreground = COLOUR_RED;
+  background = COLOUR_BLACK;
   mask = 0xff;
   state = 0;
+  dirty = 0;
+  swapped = 0;
+  rowCount = 0;
+  scanbuf = 0;
+  backScanbuf = 0;
+  blank = 0;
+  backBlank = 0;
+  swapPending = 0;
+  depth = 1;
+  pixels = 0;
+  pixelRows = 0;
+  scanRow = 0;
+  encoder = 0;
+  page = 0;
 }
 void LEDMatrix::begin(uint8_t *displaybuf, uint16_t width, uint16_t height)
 {
@@ -71,8 +117,19 @@ void LEDMatrix::begin(uint8_t *displaybuf, uint16_t width, uint16_t height)
     ASSERT(0 == (height % 16));
 
     this->displaybuf = displaybuf;
+    this->frontbuf = displaybuf;
     this->width = width;
     this->height = height;
+    setCanvas(width, height);
+
+    // a full width row of modules per 32 rows, the top row shifted first
+    segmentCount = 0;
+    chainLength = 0;
+    scanRows = MODULE_HEIGHT / 2;
+    for (uint16_t y = 0; y < height; y += MODULE_HEIGHT) {
+        MatrixTile tile = { 0, y, TILE_ROTATE_0 };
+        addTile(tile, width, MODULE_HEIGHT);
+    }
 
     pinMode(a, OUTPUT);
     pinMode(b, OUTPUT);
@@ -83,18 +140,390 @@ void LEDMatrix::begin(uint8_t *displaybuf, uint16_t width, uint16_t height)
     pinMode(r2, OUTPUT);
     pinMode(clk, OUTPUT);
     pinMode(stb, OUTPUT);
+    if (g1 != NO_PIN) {
+        pinMode(g1, OUTPUT);
+        pinMode(g2, OUTPUT);
+        pinMode(b1, OUTPUT);
+        pinMode(b2, OUTPUT);
+    }
+
+    bindPin(clkReg, clk);
+    bindPin(r1Reg, r1);
+    bindPin(r2Reg, r2);
+    bindPin(stbReg, stb);
+    bindPin(oeReg, oe);
+    bindPin(addrReg[0], a);
+    bindPin(addrReg[1], b);
+    bindPin(addrReg[2], c);
+    bindPin(addrReg[3], d);
+
+    buildColourTable();
 
     state = 1;
 }
 
+void LEDMatrix::begin(uint8_t *front, uint8_t *back, uint16_t width, uint16_t height)
+{
+    begin(back, width, height);
+    frontbuf = front;
+}
+
+bool LEDMatrix::setTileMap(const MatrixTile *tiles, uint8_t count, uint16_t moduleWidth,
+                           uint16_t moduleHeight, uint8_t scanRows)
+{
+    ASSERT(0 == (moduleWidth % 8));
+    ASSERT(scanRows <= 16 && 0 == (moduleHeight % (2 * scanRows)));
+
+    // a segment for each module row a scan row lights, 1/8 scan doubles them
+    uint32_t runs = (uint32_t) count * (moduleHeight / (2 * scanRows));
+    if (runs > MAX_SEGMENTS || runs * moduleWidth > MAX_CHAIN) {
+        return false;
+    }
+
+    segmentCount = 0;
+    chainLength = 0;
+    this->scanRows = scanRows;
+
+    // the module furthest from the controller is shifted first
+    while (count--) {
+        addTile(tiles[count], moduleWidth, moduleHeight);
+    }
+    dirty = ALL_ROWS;
+    return true;
+}
+
+// panel position of module pixel x, y
+static void placePixel(const MatrixTile &tile, uint16_t w, uint16_t h, int16_t x, int16_t y,
+                       int16_t *px, int16_t *py)
+{
+    switch (tile.rotation) {
+    case TILE_ROTATE_90:
+        *px = h - 1 - y;
+        *py = x;
+        break;
+    case TILE_ROTATE_180:
+        *px = w - 1 - x;
+        *py = h - 1 - y;
+        break;
+    case TILE_ROTATE_270:
+        *px = y;
+        *py = w - 1 - x;
+        break;
+    default:
+        *px = x;
+        *py = y;
+        break;
+    }
+    *px += tile.x;
+    *py += tile.y;
+}
+
+// a segment for each module row lit by scan row 0 in the upper half
+void LEDMatrix::addTile(const MatrixTile &tile, uint16_t moduleWidth, uint16_t moduleHeight)
+{
+    for (uint16_t y = 0; y < moduleHeight / 2; y += scanRows) {
+        ASSERT(segmentCount < MAX_SEGMENTS);
+        if (segmentCount >= MAX_SEGMENTS) {
+            return;
+        }
+
+        Segment &s = segments[segmentCount++];
+        int16_t nx, ny;
+        placePixel(tile, moduleWidth, moduleHeight, 0, y, &s.x, &s.y);
+        placePixel(tile, moduleWidth, moduleHeight, 0, y + moduleHeight / 2, &s.lowerX, &s.lowerY);
+        placePixel(tile, moduleWidth, moduleHeight, 1, y, &nx, &ny);
+        s.dx = nx - s.x;
+        s.dy = ny - s.y;
+        placePixel(tile, moduleWidth, moduleHeight, 0, y + 1, &nx, &ny);
+        s.rowX = nx - s.x;
+        s.rowY = ny - s.y;
+        s.length = moduleWidth;
+        chainLength += moduleWidth;
+    }
+}
+
+void LEDMatrix::setCanvas(uint16_t canvasWidth, uint16_t canvasHeight)
+{
+    ASSERT(0 == (canvasWidth % 8));
+    ASSERT(canvasWidth >= width && canvasHeight >= height);
+
+    this->canvasWidth = canvasWidth;
+    this->canvasHeight = canvasHeight;
+
+    memset(viewports, 0, sizeof(viewports));
+    for (uint8_t zone = 0; zone < MAX_VIEWPORTS; zone++) {
+        viewports[zone].bandHeight = canvasHeight;
+    }
+    viewports[0].height = height;
+    dirty = ALL_ROWS;
+}
+
+void LEDMatrix::setViewport(uint8_t zone, uint16_t top, uint16_t height, uint16_t x, uint16_t y)
+{
+    if (zone >= MAX_VIEWPORTS) {
+        return;
+    }
+
+    // rows the zone leaves need re-encoding as well as the ones it takes
+    touchViewport(zone);
+
+    Viewport *view = &viewports[zone];
+    if (zone) {
+        view->top = top;
+        view->height = height;
+    }
+    view->x = x % canvasWidth;
+    view->y = y % canvasHeight;
+
+    // a zone scrolls within the canvas rows it starts on, zone 0 and any
+    // zone running off the bottom of the canvas within all of it
+    view->bandTop = view->y;
+    view->bandHeight = view->height;
+    if (!zone || !view->height || view->y + view->height > canvasHeight) {
+        view->bandTop = 0;
+        view->bandHeight = canvasHeight;
+    }
+    touchViewport(zone);
+}
+
+void LEDMatrix::scrollViewport(uint8_t zone, int16_t dx, int16_t dy)
+{
+    if (zone >= MAX_VIEWPORTS) {
+        return;
+    }
+
+    Viewport *view = &viewports[zone];
+    uint16_t band = view->bandHeight;
+    view->x = (view->x + canvasWidth + dx % (int16_t) canvasWidth) % canvasWidth;
+    view->y = view->bandTop + (view->y - view->bandTop + band + dy % (int16_t) band) % band;
+    touchViewport(zone);
+}
+
+// canvas row shown on panel row y, and the canvas column at its left edge
+const uint8_t *LEDMatrix::viewRow(const uint8_t *source, uint16_t y, uint16_t *x)
+{
+    uint16_t row;
+    *x = viewAt(y, &row)->x;
+    return source + row * (canvasWidth / 8);
+}
+
+uint8_t LEDMatrix::readPixel(const uint8_t *source, int16_t x, int16_t y)
+{
+    uint16_t column;
+    const uint8_t *row = viewRow(source, y, &column);
+
+    column = (column + x) % canvasWidth;
+    return (row[column / 8] >> (7 - column % 8)) & 1;
+}
+
+// scan row, shift position and half showing panel pixel x, y
+uint8_t LEDMatrix::locate(uint16_t x, uint16_t y, uint8_t *row, uint16_t *column, uint8_t *lower)
+{
+    uint16_t start = 0;
+
+    for (uint8_t i = 0; i < segmentCount; i++) {
+        const Segment &s = segments[i];
+        for (uint8_t half = 0; half < 2; half++) {
+            int16_t sx = (half ? s.lowerX : s.x);
+            int16_t sy = (half ? s.lowerY : s.y);
+            for (uint8_t r = 0; r < scanRows; r++) {
+                int16_t ax = x - (sx + r * s.rowX);
+                int16_t ay = y - (sy + r * s.rowY);
+                int16_t along = s.dx ? ax * s.dx : ay * s.dy;
+                int16_t across = s.dx ? ay : ax;
+                if (!across && along >= 0 && along < (int16_t) s.length) {
+                    *row = r;
+                    *column = start + along;
+                    *lower = half;
+                    return 1;
+                }
+            }
+        }
+        start += s.length;
+    }
+    return 0;
+}
+
+static inline uint8_t within(int16_t y, int16_t end1, int16_t end2)
+{
+    return end1 <= end2 ? (y >= end1 && y <= end2) : (y >= end2 && y <= end1);
+}
+
+// mark the scan rows that shift panel row y
+void LEDMatrix::touchRow(uint16_t y)
+{
+    for (uint8_t i = 0; i < segmentCount; i++) {
+        const Segment &s = segments[i];
+        if (s.dy) {
+            // a turned module, every scan row crosses it
+            int16_t span = (s.length - 1) * s.dy;
+            if (within(y, s.y, s.y + span) || within(y, s.lowerY, s.lowerY + span)) {
+                dirty = ALL_ROWS;
+                return;
+            }
+            continue;
+        }
+        int16_t upper = ((int16_t) y - s.y) * s.rowY;
+        int16_t lower = ((int16_t) y - s.lowerY) * s.rowY;
+        if (upper >= 0 && upper < scanRows) {
+            dirty |= 1UL << upper;
+        }
+        if (lower >= 0 && lower < scanRows) {
+            dirty |= 1UL << lower;
+        }
+    }
+}
+
+void LEDMatrix::touchViewport(uint8_t zone)
+{
+    const Viewport *view = &viewports[zone];
+
+    for (uint16_t y = view->top; y < view->top + view->height && dirty != ALL_ROWS; y++) {
+        touchRow(y);
+    }
+}
+
+void LEDMatrix::commit()
+{
+    if (page) {
+        // nothing drawn is on show, swap straight away
+        uint8_t *drawn = displaybuf;
+        displaybuf = frontbuf;
+        frontbuf = drawn;
+        return;
+    }
+    if (backScanbuf) {
+        for (uint8_t row = 0; row < rows(); row++) {
+            encodeRow(row, displaybuf, backScanbuf);
+        }
+    }
+    swapPending = 1;
+}
+
+void LEDMatrix::show(const uint8_t *page)
+{
+    this->page = page;
+    dirty = ALL_ROWS;
+}
+
+uint8_t LEDMatrix::isCommitPending()
+{
+    return swapPending;
+}
+
+// end of a complete refresh, called from scan() or the scan engine's interrupt
+void LEDMatrix::frameComplete()
+{
+    if (!swapPending) {
+        return;
+    }
+
+    uint8_t *shown = frontbuf;
+    frontbuf = displaybuf;
+    displaybuf = shown;
+
+    if (backScanbuf) {
+        uint16_t *words = scanbuf;
+        scanbuf = backScanbuf;
+        backScanbuf = words;
+
+        uint32_t rowMask = blank;
+        blank = backBlank;
+        backBlank = rowMask;
+    } else {
+        swapped = 1;
+    }
+    swapPending = 0;
+}
+
+// mark the scan rows showing canvas rows y1 to y2 - 1 for re-encoding,
+// drawing only needs re-encoding when it is on show
+void LEDMatrix::touch(uint16_t y1, uint16_t y2)
+{
+    if (displaybuf != frontbuf || page) {
+        return;
+    }
+    if (y2 - y1 >= canvasHeight) {
+        dirty = ALL_ROWS;
+        return;
+    }
+    for (uint16_t y = y1; y < y2 && dirty != ALL_ROWS; y++) {
+        for (uint8_t zone = 0; zone < MAX_VIEWPORTS; zone++) {
+            const Viewport *view = &viewports[zone];
+            if (y < view->bandTop || y - view->bandTop >= view->bandHeight) {
+                continue;
+            }
+            uint16_t offset = (y + view->bandHeight - view->y) % view->bandHeight;
+            if (offset < view->height) {
+                touchRow(view->top + offset);
+            }
+        }
+    }
+}
+
+void LEDMatrix::bindPin(PinReg &reg, uint8_t pin)
+{
+    reg.bsrr = portSetRegister(pin);
+    reg.bit = digitalPinToBitMask(pin);
+}
+
+uint16_t LEDMatrix::colourPins(uint8_t colour, uint8_t red, uint8_t green, uint8_t blue)
+{
+    uint16_t bits = 0;
+
+    if ((colour & COLOUR_RED) && red != NO_PIN) {
+        bits |= digitalPinToBitMask(red);
+    }
+    if ((colour & COLOUR_GREEN) && green != NO_PIN) {
+        bits |= digitalPinToBitMask(green);
+    }
+    if ((colour & COLOUR_BLUE) && blue != NO_PIN) {
+        bits |= digitalPinToBitMask(blue);
+    }
+    return bits;
+}
+
+void LEDMatrix::buildColourTable()
+{
+    colourBits = colourPins(COLOUR_WHITE, r1, g1, b1) | colourPins(COLOUR_WHITE, r2, g2, b2);
+
+    packed = 1;
+    uint8_t pins[] = {r1, r2, g1, g2, b1, b2};
+    for (uint8_t i = 0; i < sizeof(pins); i++) {
+        if (pins[i] != NO_PIN && digitalPinToPort(pins[i]) != digitalPinToPort(clk)) {
+            packed = 0;
+        }
+    }
+
+    for (uint8_t index = 0; index < 4; index++) {
+        uint8_t upper = (index & 0x02) ? foreground : background;
+        uint8_t lower = (index & 0x01) ? foreground : background;
+        uint16_t set = colourPins(upper, r1, g1, b1) | colourPins(lower, r2, g2, b2);
+        uint16_t reset = (colourBits & ~set) | clkReg.bit;
+
+        colourWord[index] = set;
+        colourBsrr[index] = set | ((uint32_t)reset << 16);
+    }
+}
+
+void LEDMatrix::setColour(uint8_t foreground, uint8_t background)
+{
+    this->foreground = foreground;
+    this->background = background;
+    buildColourTable();
+    dirty = ALL_ROWS;
+}
+
 void LEDMatrix::drawPoint(uint16_t x, uint16_t y, uint8_t pixel)
 {
-    ASSERT(width > x);
-    ASSERT(height > y);
+    ASSERT(canvasWidth > x);
+    ASSERT(canvasHeight > y);
 
-    uint8_t *byte = displaybuf + x / 8 + y * width / 8;
+    uint8_t *byte = displaybuf + x / 8 + y * canvasWidth / 8;
     uint8_t  bit = x % 8;
 
+    touch(y, y + 1);
+
     if (pixel) {
         *byte |= 0x80 >> bit;
     } else {
@@ -104,38 +533,103 @@ void LEDMatrix::drawPoint(uint16_t x, uint16_t y, uint8_t pixel)
 
 void LEDMatrix::drawRect(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, uint8_t pixel)
 {
-    for (uint16_t x = x1; x < x2; x++) {
-        for (uint16_t y = y1; y < y2; y++) {
-            drawPoint(x, y, pixel);
+    if (x2 > canvasWidth) {
+        x2 = canvasWidth;
+    }
+    if (y2 > canvasHeight) {
+        y2 = canvasHeight;
+    }
+    if (x1 >= x2 || y1 >= y2) {
+        return;
+    }
+
+    uint8_t fill = pixel ? 0xff : 0x00;
+    uint16_t first = x1 / 8;
+    uint16_t last = (x2 - 1) / 8;
+    uint8_t left = 0xff >> (x1 % 8);            // bits from x1 in the first byte
+    uint8_t right = 0xff << (7 - (x2 - 1) % 8); // bits up to x2 - 1 in the last byte
+
+    if (first == last) {
+        left &= right;
+    }
+
+    for (uint16_t y = y1; y < y2; y++) {
+        uint8_t *row = displaybuf + y * (canvasWidth / 8);
+
+        row[first] = (row[first] & ~left) | (fill & left);
+        if (first != last) {
+            memset(row + first + 1, fill, last - first - 1);
+            row[last] = (row[last] & ~right) | (fill & right);
         }
     }
+    touch(y1, y2);
+}
+
+uint8_t *LEDMatrix::openRows(uint16_t y1, uint16_t y2)
+{
+    touch(y1, y2);
+    return displaybuf + y1 * (canvasWidth / 8);
 }
 
 void LEDMatrix::drawImage(uint16_t xoffset, uint16_t yoffset, uint16_t width, uint16_t height, const uint8_t *image)
 {
-	  for (uint16_t y = 0; y < height; y++) {
-		    for (uint16_t x = 0; x < width; x++) {
-			      const uint8_t *byte = image + (x + y * width) / width;
-            uint8_t  bit = 7 - x % 8;
-			      uint8_t  pixel = (*byte >> bit) & 1;
+    PROFILE_SCOPE(PROFILE_DRAW);
+
+    if (xoffset >= canvasWidth || yoffset >= canvasHeight) {
+        return;
+    }
+
+    uint16_t stride = (width + 7) / 8;          // image rows are byte aligned
+    if (width > canvasWidth - xoffset) {
+        width = canvasWidth - xoffset;
+    }
+    if (height > canvasHeight - yoffset) {
+        height = canvasHeight - yoffset;
+    }
+
+    // each source byte lands across two destination bytes
+    uint8_t shift = xoffset % 8;
+
+    for (uint16_t y = 0; y < height; y++) {
+        const uint8_t *src = image + y * stride;
+        uint8_t *dst = displaybuf + (y + yoffset) * (canvasWidth / 8) + xoffset / 8;
+
+        if (!shift) {
+            // byte aligned, only a partial last byte needs masking
+            uint16_t whole = width / 8;
+            memcpy(dst, src, whole);
+            if (width % 8) {
+                uint8_t keep = 0xff00 >> (width % 8);
+                dst[whole] = (dst[whole] & ~keep) | (src[whole] & keep);
+            }
+            continue;
+        }
 
-            drawPoint(x + xoffset, y + yoffset, pixel);
+        for (uint16_t x = 0; x < width; x += 8) {
+            uint8_t bits = (width - x) < 8 ? (width - x) : 8;
+            uint16_t keep = (uint16_t)(0xff00 << (8 - bits)) >> shift;  // source bits to copy
+            uint16_t value = ((uint16_t)*src++ << 8) >> shift;
+
+            dst[0] = (dst[0] & ~(keep >> 8)) | ((value & keep) >> 8);
+            if (keep & 0xff) {
+                dst[1] = (dst[1] & ~keep) | (value & keep);
+            }
+            dst++;
         }
     }
+    touch(yoffset, yoffset + height);
 }
 
 void LEDMatrix::clear()
 {
-    uint8_t *ptr = displaybuf;
-    for (uint16_t i = 0; i < (width * height / 8); i++) {
-        *ptr = 0x00;
-        ptr++;
-    }
+    memset(displaybuf, 0x00, canvasWidth * canvasHeight / 8);
+    touch(0, canvasHeight);
 }
 
 void LEDMatrix::reverse()
 {
     mask = ~mask;
+    dirty = ALL_ROWS;
 }
 
 uint8_t LEDMatrix::isReversed()
@@ -145,56 +639,274 @@ uint8_t LEDMatrix::isReversed()
 
 void LEDMatrix::scan()
 {
-    static uint8_t row = 0;  // from 0 to 31
-
     if (!state) {
         return;
     }
 
-    uint8_t *head = displaybuf + row * (width / 8);
-	uint8_t red = row < 16 ? r1 : r2;
-
-    for (uint8_t line = 0; line < (height / MODULE_HEIGHT); line++) {
-        uint8_t *ptr = head;
-        head += width * 2;              // width * 16 / 8
-
-        for (uint8_t byte = 0; byte < (width / 8); byte++) {
-            uint8_t pixels = *ptr;
-            ptr++;
-            pixels = pixels ^ mask;     // reverse: mask = 0xff, normal: mask =0x00
+    shiftRow(scanRow, page ? page : frontbuf, [this](uint8_t top, uint8_t bottom) {
+        if (packed) {
+            // one store sets every colour line and drops clk
+            volatile uint32_t *bsrr = clkReg.bsrr;
             for (uint8_t bit = 0; bit < 8; bit++) {
-                digitalWrite(clk, LOW);
-                digitalWrite(red, pixels & (0x80 >> bit));
-                digitalWrite(clk, HIGH);
+                PORT_WRITE(bsrr, colourBsrr[((top >> 6) & 0x02) | (bottom >> 7)]);
+                PORT_WRITE(bsrr, clkReg.bit);
+                top <<= 1;
+                bottom <<= 1;
+            }
+        } else {
+            for (uint8_t bit = 0; bit < 8; bit++) {
+                write(clkReg, LOW);
+                write(r1Reg, top & (0x80 >> bit));
+                write(r2Reg, bottom & (0x80 >> bit));
+                write(clkReg, HIGH);
             }
         }
-    }
+    });
 
-    digitalWrite(oe, HIGH);              // disable display
+    latchRow();
+}
+
+void LEDMatrix::latchRow()
+{
+    write(oeReg, HIGH);                 // disable display
 
     // select row
-    digitalWrite(a, (row & 0x01));
-    digitalWrite(b, (row & 0x02));
-    digitalWrite(c, (row & 0x04));
-    digitalWrite(d, (row & 0x08));
+    write(addrReg[0], scanRow & 0x01);
+    write(addrReg[1], scanRow & 0x02);
+    write(addrReg[2], scanRow & 0x04);
+    write(addrReg[3], scanRow & 0x08);
 
     // latch data
-    digitalWrite(stb, LOW);
-    digitalWrite(stb, HIGH);
-    digitalWrite(stb, LOW);
+    write(stbReg, HIGH);
+    write(stbReg, LOW);
 
-    digitalWrite(oe, LOW);              // enable display
+    write(oeReg, LOW);                  // enable display
 
-    row = (row + 1) & 0x1f;
+    scanRow = (scanRow + 1) % rows();
+    if (scanRow == 0) {
+        frameComplete();
+    }
 }
 
 void LEDMatrix::on()
 {
     state = 1;
+    dirty = ALL_ROWS;
 }
 
 void LEDMatrix::off()
 {
     state = 0;
+    dirty = ALL_ROWS;
     digitalWrite(oe, HIGH);
 }
+
+void LEDMatrix::setScanBuffer(uint16_t *scanbuf, uint8_t depth)
+{
+    setScanBuffer(scanbuf, 0, depth);
+}
+
+void LEDMatrix::setScanBuffer(uint16_t *scanbuf, uint16_t *back, uint8_t depth)
+{
+    ASSERT(depth > 0 && depth <= 8);
+
+    this->scanbuf = scanbuf;
+    this->backScanbuf = back;
+    this->depth = depth;
+
+    // the scan engine writes whole port words, so keep whatever the rest of
+    // the colour port is doing and hold stb and oe low while shifting
+    portBase = digitalPinToPort(r1)->regs->ODR;
+    portBase &= ~(colourBits | digitalPinToBitMask(stb) | digitalPinToBitMask(oe));
+
+    dirty = ALL_ROWS;
+    update();
+}
+
+void LEDMatrix::update()
+{
+    PROFILE_SCOPE(PROFILE_ENCODE);
+
+    if (!scanbuf) {
+        return;
+    }
+
+    // a buffer swap from the scan interrupt needs every row
+    uint32_t rowMask = dirty;
+    if (swapped) {
+        swapped = 0;
+        rowMask = ALL_ROWS;
+    }
+    dirty = 0;
+
+    for (uint8_t row = 0; rowMask && row < rows(); row++) {
+        if (rowMask & (1UL << row)) {
+            encodeRow(row);
+            rowCount++;
+        }
+        rowMask &= ~(1UL << row);
+    }
+}
+
+uint8_t LEDMatrix::dirtyRows()
+{
+    uint32_t rowMask = swapped ? ALL_ROWS : dirty;
+    uint8_t count = 0;
+
+    for (uint8_t row = 0; row < rows(); row++) {
+        if (rowMask & (1UL << row)) {
+            count++;
+        }
+    }
+    return count;
+}
+
+uint32_t LEDMatrix::encodedRows()
+{
+    return rowCount;
+}
+
+void LEDMatrix::encodeRow(uint8_t row)
+{
+    encodeRow(row, page ? page : frontbuf, scanbuf);
+}
+
+void LEDMatrix::encodeRow(uint8_t row, const uint8_t *source, uint16_t *dest)
+{
+    ASSERT(rows() > row);
+
+    uint16_t *first = dest + row * columns();
+    uint16_t *word = first;
+    uint16_t base = portBase;
+    if (!state) {
+        base |= digitalPinToBitMask(oe);    // shifting must not enable the display
+    }
+    if (encoder) {
+        encoder(this, row, source, word, base);
+    } else {
+        shiftRow(row, source, [&word, base, this](uint8_t top, uint8_t bottom) {
+            for (uint8_t bit = 0; bit < 8; bit++) {
+                *word++ = base | colourWord[((top >> 6) & 0x02) | (bottom >> 7)];
+                top <<= 1;
+                bottom <<= 1;
+            }
+        });
+    }
+
+    // the display buffer is one bit per pixel, every plane is the same
+    for (uint8_t plane = 1; plane < depth; plane++) {
+        memcpy(first + plane * rows() * columns(), first, columns() * sizeof(uint16_t));
+    }
+
+    uint8_t pixelsLit = 0;
+    if (pixels && (pixelRows & (1UL << row))) {
+        pixelsLit = overlayPixels(row, first);
+    }
+
+    // the scan engine leaves rows showing only a black background unshifted,
+    // and every row while the display is off
+    uint32_t *rowMask = dest == backScanbuf ? &backBlank : &blank;
+    uint16_t unlit = base | colourWord[mask & 0x03];
+    uint16_t column = 0;
+    while (state && background == COLOUR_BLACK && column < columns() && first[column] == unlit) {
+        column++;
+    }
+    if (!state || (column == columns() && !pixelsLit)) {
+        *rowMask |= 1UL << row;
+    } else {
+        *rowMask &= ~(1UL << row);
+    }
+}
+
+// lay the drawPixel() colours over a scan row's planes, non-zero if any is lit
+uint8_t LEDMatrix::overlayPixels(uint8_t row, uint16_t *first)
+{
+    // with the default mask the data lines are active low
+    uint8_t flip = mask ? COLOUR_WHITE : COLOUR_BLACK;
+    uint16_t upperBits = colourPins(COLOUR_WHITE, r1, g1, b1);
+    uint16_t lowerBits = colourPins(COLOUR_WHITE, r2, g2, b2);
+    uint16_t upper[8], lower[8];
+    for (uint8_t colour = 0; colour < 8; colour++) {
+        upper[colour] = colourPins(colour ^ flip, r1, g1, b1);
+        lower[colour] = colourPins(colour ^ flip, r2, g2, b2);
+    }
+
+    uint8_t lit = 0;
+    for (uint8_t plane = 0; plane < depth; plane++) {
+        const uint8_t *pixel = pixels + (plane * rows() + row) * columns();
+        uint16_t *word = first + plane * rows() * columns();
+        for (uint16_t column = 0; column < columns(); column++) {
+            uint8_t set = pixel[column];
+            if (set & PIXEL_UPPER) {
+                word[column] = (word[column] & ~upperBits) | upper[set & COLOUR_WHITE];
+                lit |= set & COLOUR_WHITE;
+            }
+            if (set & PIXEL_LOWER) {
+                word[column] = (word[column] & ~lowerBits) | lower[(set >> 4) & COLOUR_WHITE];
+                lit |= (set >> 4) & COLOUR_WHITE;
+            }
+        }
+    }
+    return lit;
+}
+
+void LEDMatrix::setPixelBuffer(uint8_t *pixels)
+{
+    this->pixels = pixels;
+    if (pixels) {
+        memset(pixels, 0, (uint32_t) depth * rows() * columns());
+    }
+    dirty |= pixelRows;
+    pixelRows = 0;
+}
+
+void LEDMatrix::drawPixel(uint16_t x, uint16_t y, uint8_t red, uint8_t green, uint8_t blue)
+{
+    ASSERT(width > x);
+    ASSERT(height > y);
+
+    uint8_t row, lowerHalf;
+    uint16_t column;
+    if (!pixels || !locate(x, y, &row, &column, &lowerHalf)) {
+        return;
+    }
+
+    uint8_t *pixel = pixels + row * columns() + column;
+    for (uint8_t plane = 0; plane < depth; plane++) {
+        uint8_t colour = ((red >> plane) & 1) * COLOUR_RED |
+                         ((green >> plane) & 1) * COLOUR_GREEN |
+                         ((blue >> plane) & 1) * COLOUR_BLUE;
+        if (lowerHalf) {
+            *pixel = (*pixel & 0x0f) | PIXEL_LOWER | (colour << 4);
+        } else {
+            *pixel = (*pixel & 0xf0) | PIXEL_UPPER | colour;
+        }
+        pixel += rows() * columns();
+    }
+    pixelRows |= 1UL << row;
+    dirty |= 1UL << row;
+}
+
+void LEDMatrix::clearPixels()
+{
+    if (pixels) {
+        memset(pixels, 0, (uint32_t) depth * rows() * columns());
+    }
+    dirty |= pixelRows;
+    pixelRows = 0;
+}
+
+uint8_t LEDMatrix::rows()
+{
+    return scanRows;
+}
+
+uint16_t LEDMatrix::columns()
+{
+    return chainLength;
+}
+
+uint8_t LEDMatrix::planes()
+{
+    return depth;
+}
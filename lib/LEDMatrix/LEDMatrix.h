@@ -23,24 +23,56 @@
 #define __LED_MATRIX_H__
 
  #include <stdint.h>
+ #include "FastPin.h"
+
+#define NO_PIN          0xff
+
+// colours are one bit per channel, matching the HUB75 R, G and B lines
+#define COLOUR_BLACK    0
+#define COLOUR_RED      1
+#define COLOUR_GREEN    2
+#define COLOUR_BLUE     4
+#define COLOUR_YELLOW   (COLOUR_RED | COLOUR_GREEN)
+#define COLOUR_WHITE    (COLOUR_RED | COLOUR_GREEN | COLOUR_BLUE)
+
+#define MAX_VIEWPORTS   5       // zone 0 plus one per text line
+
+// module orientation, turned clockwise from upright
+#define TILE_ROTATE_0   0
+#define TILE_ROTATE_90  1
+#define TILE_ROTATE_180 2
+#define TILE_ROTATE_270 3
+
+#define MAX_SEGMENTS    16      // modules * module rows lit per scan row and half
+#define MAX_CHAIN       256     // pixels shifted per scan row, the scan engine counts them in 8 bits
+
+/**
+ * one module of a tiled panel, where its top left corner lands once turned
+ */
+struct MatrixTile {
+    uint16_t x;
+    uint16_t y;
+    uint8_t rotation;
+};
 
 class LEDMatrix;
+class ScanEngine;
 
 class MatrixBuilder {
 public:
   MatrixBuilder& a(uint8_t pin_a) {_a = pin_a; return *this;};
   MatrixBuilder& b(uint8_t pin_b) {_b = pin_b; return *this;};
-  MatrixBuilder c(uint8_t);
-  MatrixBuilder d(uint8_t);
-  MatrixBuilder oe(uint8_t);
-  MatrixBuilder clk(uint8_t);
-  MatrixBuilder lat(uint8_t);
-  MatrixBuilder r1(uint8_t);
-  MatrixBuilder r2(uint8_t);
-  MatrixBuilder g1(uint8_t);
-  MatrixBuilder g2(uint8_t);
-  MatrixBuilder b1(uint8_t);
-  MatrixBuilder b2(uint8_t);
+  MatrixBuilder& c(uint8_t pin_c) {_c = pin_c; return *this;};
+  MatrixBuilder& d(uint8_t pin_d) {_d = pin_d; return *this;};
+  MatrixBuilder& oe(uint8_t pin_oe) {_oe = pin_oe; return *this;};
+  MatrixBuilder& clk(uint8_t pin_clk) {_clk = pin_clk; return *this;};
+  MatrixBuilder& lat(uint8_t pin_lat) {_lat = pin_lat; return *this;};
+  MatrixBuilder& r1(uint8_t pin_r1) {_r1 = pin_r1; return *this;};
+  MatrixBuilder& r2(uint8_t pin_r2) {_r2 = pin_r2; return *this;};
+  MatrixBuilder& g1(uint8_t pin_g1) {_g1 = pin_g1; return *this;};
+  MatrixBuilder& g2(uint8_t pin_g2) {_g2 = pin_g2; return *this;};
+  MatrixBuilder& b1(uint8_t pin_b1) {_b1 = pin_b1; return *this;};
+  MatrixBuilder& b2(uint8_t pin_b2) {_b2 = pin_b2; return *this;};
   LEDMatrix create();
 
 private:
@@ -73,19 +105,93 @@ public:
      */
     void begin(uint8_t *displaybuf, uint16_t width, uint16_t height);
 
+    /**
+     * double buffered begin, drawing goes to back and front is shown until commit()
+     * @param front     display buffer shown first
+     * @param back      display buffer drawn into
+     */
+    void begin(uint8_t *front, uint8_t *back, uint16_t width, uint16_t height);
+
+    /**
+     * describe how the panel is built from modules, replacing the default of
+     * 32 row, 1/16 scan modules in full width rows shifted top row first. The
+     * description is compiled into a table of straight runs of pixels, so
+     * encoding walks the table instead of working out where each pixel goes.
+     * Call before setScanBuffer(), rows() and columns() follow the modules.
+     * @param tiles         modules in chain order, from the one the controller plugs into
+     * @param moduleWidth   upright module width, a multiple of 8
+     * @param moduleHeight  upright module height
+     * @param scanRows      multiplexed rows, 16 on 1/16 scan modules and 8 on 1/8 scan
+     * Each scan row lights moduleHeight / (2 * scanRows) module rows in each
+     * half of a module, they are shifted top one first. Turn alternate rows of
+     * a serpentine chain by 180 degrees.
+     * @return false, keeping the layout there was, if the modules need more
+     *         than MAX_SEGMENTS runs or shift more than MAX_CHAIN pixels a row
+     */
+    bool setTileMap(const MatrixTile *tiles, uint8_t count, uint16_t moduleWidth,
+                    uint16_t moduleHeight, uint8_t scanRows);
+
+    /**
+     * draw on a canvas larger than the panel, the display buffers must hold
+     * canvasWidth * canvasHeight / 8 bytes. Drawing is clipped to the canvas
+     * and viewports choose which part of it each band of the panel shows.
+     * Resets the viewports to zone 0 showing the canvas from 0, 0.
+     * @param canvasWidth   multiple of 8, at least the panel width
+     * @param canvasHeight  at least the panel height
+     */
+    void setCanvas(uint16_t canvasWidth, uint16_t canvasHeight);
+
+    /**
+     * show the canvas from x, y in panel rows top to top + height - 1, a
+     * higher zone wins where zones overlap. Zone 0 always covers the whole
+     * panel so its top and height are ignored. The zone scrolls vertically
+     * within canvas rows y to y + height - 1, zone 0 within the whole canvas.
+     * @param zone      0 to MAX_VIEWPORTS - 1
+     * @param height    0 removes the zone
+     */
+    void setViewport(uint8_t zone, uint16_t top, uint16_t height, uint16_t x, uint16_t y);
+
+    /**
+     * move a zone's view of the canvas, wrapping round at the canvas's left
+     * and right edges and at the top and bottom of the zone's own rows. Only
+     * the zone's rows are re-encoded, nothing is redrawn.
+     */
+    void scrollViewport(uint8_t zone, int16_t dx, int16_t dy);
+
+    /**
+     * show the back buffer, the buffers are swapped at the end of the current
+     * refresh so a whole page appears in one frame. The back buffer then holds
+     * the page that was on show.
+     */
+    void commit();
+
+    /**
+     * show a stored page instead of the display buffer. The page is not
+     * copied, switching costs one re-encode of the scan buffer. Drawing and
+     * commit() carry on unseen until show(0) goes back to the display buffer.
+     * @param page  canvasWidth * canvasHeight / 8 bytes, 0 for the display buffer
+     */
+    void show(const uint8_t *page);
+
+    /**
+     * true until the buffers requested by commit() have been swapped
+     */
+    uint8_t isCommitPending();
+
     /**
      * draw a point
      * @param x     x
      * @param y     y
      * @param pixel 0: led off, >0: led on
      */
-    void drawPoint(uint16_t x, uint16_t y, uint8_t pixel);
+    virtual void drawPoint(uint16_t x, uint16_t y, uint8_t pixel);
 
     /**
      * draw a rect
      * @param (x1, y1)   top-left position
      * @param (x2, y2)   bottom-right position, not included in the rect
      * @param pixel      0: rect off, >0: rect on
+     * The rect is clipped to the display and filled a byte at a time.
      */
     void drawRect(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, uint8_t pixel);
 
@@ -93,20 +199,43 @@ public:
      * draw a image
      * @param (xoffset, yoffset)   top-left offset of image
      * @param (width, height)      image's width and height
-     * @param pixels     contents, 1 bit to 1 led
+     * @param pixels     contents, 1 bit to 1 led, each row starts on a new byte
+     * The image is clipped to the display and copied a byte at a time.
      */
     void drawImage(uint16_t xoffset, uint16_t yoffset, uint16_t width, uint16_t height, const uint8_t *image);
 
+    /**
+     * canvas rows y1 to y2 - 1 of the buffer drawn into, for decoders that
+     * write it in place. The rows are marked for re-encoding and are
+     * canvasWidth / 8 bytes apart.
+     */
+    uint8_t *openRows(uint16_t y1, uint16_t y2);
+
     /**
      * Set screen buffer to zero
      */
-    void clear();
+    virtual void clear();
 
     /**
      * turn off 1/16 leds and turn on another 1/16 leds
      */
     void scan();
 
+    /**
+     * scan() with the clock and data pins bound at compile time, each clock
+     * edge is a single store to the port's BSRR. CLK, R1 and R2 must share a port.
+     */
+    template <uint8_t CLK, uint8_t R1, uint8_t R2>
+    void scan();
+
+    /**
+     * set the colours lit and unlit pixels are shown in, only red is
+     * available on panels built with the 9 pin constructor
+     * @param foreground    COLOUR_* for pixels that are on
+     * @param background    COLOUR_* for pixels that are off
+     */
+    void setColour(uint8_t foreground, uint8_t background = COLOUR_BLACK);
+
     void reverse();
 
     uint8_t isReversed();
@@ -115,15 +244,303 @@ public:
 
     void off();
 
-private:
+    /**
+     * set the buffer the scan engine streams from, one port word per shifted column
+     * and bit plane. Plane n is shown for 2^n times as long as plane 0 (binary code
+     * modulation), so depth bits per channel costs depth shifts per row.
+     * Only part of a grey scale frame buffer: the display buffer stays one bit
+     * per pixel and lights every plane alike, only drawPixel() colours use the
+     * planes for intensity. Depth above 1 needs setPixelBuffer() to be of use.
+     * @param scanbuf   port words, must hold depth * rows() * columns() words
+     * @param depth     bits per colour channel, 1 to 8
+     */
+    void setScanBuffer(uint16_t *scanbuf, uint8_t depth = 1);
+
+    /**
+     * double buffered scan buffer, commit() encodes the back display buffer into
+     * back and the scan buffers are swapped along with the display buffers.
+     * Without one the new front is re-encoded by update() after the swap.
+     */
+    void setScanBuffer(uint16_t *scanbuf, uint16_t *back, uint8_t depth = 1);
+
+    /**
+     * keep the colours set with drawPixel(), encoding lays them over whatever
+     * the display buffer has in the same place. Call after setScanBuffer().
+     * @param pixels    depth * rows() * columns() bytes, cleared here
+     */
+    void setPixelBuffer(uint8_t *pixels);
+
+    /**
+     * colour a pixel with depth bits per channel until clearPixels(). The
+     * position is on the panel rather than the canvas, so viewports, pages
+     * and scrolling move underneath it. Does nothing without a pixel buffer.
+     * @param x, y                  position
+     * @param red, green, blue      intensity, 0 to 2^depth - 1
+     */
+    void drawPixel(uint16_t x, uint16_t y, uint8_t red, uint8_t green, uint8_t blue);
+
+    /**
+     * forget every drawPixel(), the display buffer shows through again
+     */
+    void clearPixels();
+
+    /**
+     * re-encode the scan rows drawn into since the last call
+     */
+    void update();
+
+    /**
+     * number of scan rows waiting for update(), a text line dirties 8 of 16
+     */
+    uint8_t dirtyRows();
+
+    /**
+     * total scan rows encoded by update()
+     */
+    uint32_t encodedRows();
+
+    /**
+     * encode one scan row of the display buffer into port words
+     * @param row   scan row, 0 to rows() - 1
+     */
+    void encodeRow(uint8_t row);
+
+    /**
+     * number of multiplexed rows, 1/16 scan modules have 16
+     */
+    uint8_t rows();
+
+    /**
+     * number of columns shifted out for each scan row
+     */
+    uint16_t columns();
+
+    /**
+     * bits per colour channel in the scan buffer
+     */
+    uint8_t planes();
+
+protected:
+    friend class ScanEngine;
+
+    // fills the port words for one scan row, in place of walking the segments
+    typedef void (*RowEncoder)(LEDMatrix *matrix, uint8_t row, const uint8_t *source,
+                               uint16_t *word, uint16_t base);
+
+    struct PinReg {
+        volatile uint32_t *bsrr;
+        uint32_t bit;
+    };
+
+    static inline void write(const PinReg &pin, uint8_t level)
+    {
+        PORT_WRITE(pin.bsrr, level ? pin.bit : pin.bit << 16);
+    }
+
+    struct Viewport {
+        uint16_t top;
+        uint16_t height;
+        uint16_t x;
+        uint16_t y;
+        uint16_t bandTop;       // canvas rows y wraps within
+        uint16_t bandHeight;
+    };
+
+    // the viewport showing panel row y, and the canvas row it shows there
+    inline const Viewport *viewAt(uint16_t y, uint16_t *row)
+    {
+        const Viewport *view = &viewports[0];
+
+        for (uint8_t zone = MAX_VIEWPORTS - 1; zone > 0; zone--) {
+            const Viewport *v = &viewports[zone];
+            if (y >= v->top && y - v->top < v->height) {
+                view = v;
+                break;
+            }
+        }
+
+        *row = y - view->top + view->y;
+        if (*row >= view->bandTop + view->bandHeight) {
+            *row -= view->bandHeight;
+        }
+        return view;
+    }
+
+    // 8 canvas pixels from x, wrapping round at the canvas edge
+    inline uint8_t canvasByte(const uint8_t *row, uint16_t x)
+    {
+        uint16_t index = x / 8;
+        uint8_t shift = x % 8;
+        if (!shift) {
+            return row[index];
+        }
+        uint16_t next = index + 1 == canvasWidth / 8 ? 0 : index + 1;
+        return (row[index] << shift) | (row[next] >> (8 - shift));
+    }
+
+    inline uint16_t nextByte(uint16_t x)
+    {
+        x += 8;
+        return x >= canvasWidth ? x - canvasWidth : x;
+    }
+
+    inline uint16_t prevByte(uint16_t x)
+    {
+        return x < 8 ? x + canvasWidth - 8 : x - 8;
+    }
+
+    static inline uint8_t reverseBits(uint8_t b)
+    {
+        b = (b >> 4) | (b << 4);
+        b = ((b & 0xcc) >> 2) | ((b & 0x33) << 2);
+        return ((b & 0xaa) >> 1) | ((b & 0x55) << 1);
+    }
+
+    // a straight run of panel pixels shifted for each scan row, the upper and
+    // lower halves of a module are shifted together
+    struct Segment {
+        int16_t x, y;           // first upper pixel, scan row 0
+        int16_t lowerX, lowerY; // first lower pixel
+        int8_t dx, dy;          // step along the run
+        int8_t rowX, rowY;      // step to the next scan row
+        uint16_t length;
+    };
+
+    template <typename Emit>
+    void shiftRow(uint8_t row, const uint8_t *source, Emit emit);
+    void addTile(const MatrixTile &tile, uint16_t moduleWidth, uint16_t moduleHeight);
+    uint8_t readPixel(const uint8_t *source, int16_t x, int16_t y);
+    uint8_t locate(uint16_t x, uint16_t y, uint8_t *row, uint16_t *column, uint8_t *lower);
+    void touchRow(uint16_t y);
+    virtual const uint8_t *viewRow(const uint8_t *source, uint16_t y, uint16_t *x);
+    void touchViewport(uint8_t zone);
+    void bindPin(PinReg &reg, uint8_t pin);
+    void latchRow();
+    void touch(uint16_t y1, uint16_t y2);
+    void frameComplete();
+    void encodeRow(uint8_t row, const uint8_t *source, uint16_t *dest);
+    uint8_t overlayPixels(uint8_t row, uint16_t *first);
+    void buildColourTable();
+    uint16_t colourPins(uint8_t colour, uint8_t red, uint8_t green, uint8_t blue);
+
 	uint8_t a, b, c, d;
   uint8_t clk, stb, oe;
   uint8_t r1, r2, g1, g2, b1, b2;
-    uint8_t *displaybuf;
-    uint16_t width;
+    uint8_t *displaybuf;        // drawn into
+    uint8_t *frontbuf;          // shown, the same as displaybuf unless double buffered
+    const uint8_t *page;        // shown instead of frontbuf when set
+    volatile uint8_t swapPending;
+    uint16_t width;             // panel
     uint16_t height;
+    uint16_t canvasWidth;       // display buffers
+    uint16_t canvasHeight;
+    Viewport viewports[MAX_VIEWPORTS];
+    Segment  segments[MAX_SEGMENTS];
+    uint8_t  segmentCount;
+    uint8_t  scanRows;
+    uint16_t chainLength;       // pixels shifted per scan row and half
     uint8_t  mask;
     uint8_t  state;
+    uint32_t dirty;             // bit per scan row
+    volatile uint8_t swapped;   // set by frameComplete(), every row is dirty
+    uint32_t rowCount;
+    uint16_t *scanbuf;
+    uint16_t *backScanbuf;
+    uint32_t blank;             // bit per scan row with nothing lit in scanbuf
+    uint32_t backBlank;         // the same for backScanbuf
+    uint8_t  depth;
+    uint8_t *pixels;            // drawPixel() colours, a byte per scan word and plane
+    uint32_t pixelRows;         // bit per scan row with a pixel set
+    uint16_t portBase;      // port bits not driven by the encoder
+    uint8_t  foreground, background;
+    uint8_t  packed;            // clk and all colour pins share one port
+    uint16_t colourBits;        // every colour pin on the port
+    // indexed by (upper pixel << 1) | lower pixel
+    uint16_t colourWord[4];     // port bits to set
+    uint32_t colourBsrr[4];     // BSRR word, also drives clk low
+    uint8_t  scanRow;
+    RowEncoder encoder;         // 0: shiftRow() through the segments
+    PinReg   clkReg, r1Reg, r2Reg, stbReg, oeReg;
+    PinReg   addrReg[4];
 };
 
+// hand emit() the next 8 upper and lower pixels shifted for a scan row, in
+// shift order with reverse() applied, first pixel in the top bit
+template <typename Emit>
+void LEDMatrix::shiftRow(uint8_t row, const uint8_t *source, Emit emit)
+{
+    for (uint8_t i = 0; i < segmentCount; i++) {
+        const Segment &s = segments[i];
+        int16_t ux = s.x + row * s.rowX;
+        int16_t uy = s.y + row * s.rowY;
+        int16_t lx = s.lowerX + row * s.rowX;
+        int16_t ly = s.lowerY + row * s.rowY;
+
+        if (s.dx == 1) {
+            // along a panel row, a byte at a time
+            uint16_t uc, lc;
+            const uint8_t *upper = viewRow(source, uy, &uc);
+            const uint8_t *lower = viewRow(source, ly, &lc);
+            uc = (uc + ux) % canvasWidth;
+            lc = (lc + lx) % canvasWidth;
+            for (uint16_t n = 0; n < s.length; n += 8) {
+                emit(canvasByte(upper, uc) ^ mask, canvasByte(lower, lc) ^ mask);
+                uc = nextByte(uc);
+                lc = nextByte(lc);
+            }
+        } else if (s.dx == -1) {
+            // a module turned upside down, backwards along the row
+            uint16_t uc, lc;
+            const uint8_t *upper = viewRow(source, uy, &uc);
+            const uint8_t *lower = viewRow(source, ly, &lc);
+            uc = (uc + ux + canvasWidth - 7) % canvasWidth;
+            lc = (lc + lx + canvasWidth - 7) % canvasWidth;
+            for (uint16_t n = 0; n < s.length; n += 8) {
+                emit(reverseBits(canvasByte(upper, uc)) ^ mask, reverseBits(canvasByte(lower, lc)) ^ mask);
+                uc = prevByte(uc);
+                lc = prevByte(lc);
+            }
+        } else {
+            // a module on its side, down or up a panel column
+            for (uint16_t n = 0; n < s.length; n += 8) {
+                uint8_t top = 0;
+                uint8_t bottom = 0;
+                for (uint8_t bit = 0; bit < 8; bit++) {
+                    top = (top << 1) | readPixel(source, ux, uy);
+                    bottom = (bottom << 1) | readPixel(source, lx, ly);
+                    ux += s.dx;
+                    uy += s.dy;
+                    lx += s.dx;
+                    ly += s.dy;
+                }
+                emit(top ^ mask, bottom ^ mask);
+            }
+        }
+    }
+}
+
+template <uint8_t CLK, uint8_t R1, uint8_t R2>
+void LEDMatrix::scan()
+{
+    static_assert(FastPin<CLK>::port == FastPin<R1>::port && FastPin<CLK>::port == FastPin<R2>::port,
+                  "CLK, R1 and R2 must be on the same port");
+
+    if (!state) {
+        return;
+    }
+
+    volatile uint32_t *bsrr = &FastPin<CLK>::bsrr();
+
+    shiftRow(scanRow, page ? page : frontbuf, [bsrr](uint8_t top, uint8_t bottom) {
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            PORT_WRITE(bsrr, FastPin<CLK>::word(0) |
+                             FastPin<R1>::word(top & (0x80 >> bit)) |
+                             FastPin<R2>::word(bottom & (0x80 >> bit)));
+            PORT_WRITE(bsrr, FastPin<CLK>::word(1));
+        }
+    });
+
+    latchRow();
+}
+
 #endif
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2017 David McKelvie.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Profile.h"
+
+#if PROFILE
+
+profile_stat_t profile_stats[PROFILE_SECTIONS];
+profile_period_t profile_row_period;
+uint32_t profile_high_water;
+
+const char *const profile_names[PROFILE_SECTIONS] = {
+    "scan row",
+    "encode",
+    "spi",
+    "process",
+    "print",
+    "draw",
+    "decode",
+    "sleep",
+};
+
+void profile_row()
+{
+    uint32_t now = cycles_now();
+    profile_period_t *period = &profile_row_period;
+
+    if (period->last) {
+        uint32_t cycles = now - period->last;
+        period->count++;
+        period->total += cycles;
+        if (!period->min || cycles < period->min) {
+            period->min = cycles;
+        }
+        if (cycles > period->max) {
+            period->max = cycles;
+        }
+    }
+    period->last = now;
+}
+
+void profile_reset()
+{
+    for (uint8_t i = 0; i < PROFILE_SECTIONS; i++) {
+        profile_stats[i].calls = 0;
+        profile_stats[i].cycles = 0;
+        profile_stats[i].max = 0;
+    }
+    profile_row_period.count = 0;
+    profile_row_period.total = 0;
+    profile_row_period.min = 0;
+    profile_row_period.max = 0;
+    profile_row_period.last = 0;
+    profile_high_water = 0;
+}
+
+#endif
@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2017 David McKelvie.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __PROFILE_H__
+#define __PROFILE_H__
+
+#include <stdint.h>
+
+/*
+ * DWT cycle counts per code section, built with -D PROFILE=1. Without it
+ * every macro below expands to nothing and no counters are allocated.
+ *
+ * Times are inclusive, a section interrupted by the scan or SPI handlers
+ * is charged for them too.
+ */
+
+#ifndef PROFILE
+#define PROFILE 0
+#endif
+
+typedef enum {
+    PROFILE_SCAN_ROW,       // ScanEngine row interrupt
+    PROFILE_ENCODE,         // LEDMatrix::update()
+    PROFILE_SPI,            // SPI receive DMA interrupt
+    PROFILE_PROCESS,        // process_character()
+    PROFILE_PRINT,          // printLine()
+    PROFILE_DRAW,           // LEDMatrix::drawImage()
+    PROFILE_DECODE,         // run length coded region updates
+    PROFILE_SLEEP,          // loop() waiting for an interrupt, what is left over
+    PROFILE_SECTIONS
+} profile_section_t;
+
+typedef struct {
+    uint32_t calls;
+    uint64_t cycles;
+    uint32_t max;
+} profile_stat_t;
+
+typedef struct {
+    uint32_t count;
+    uint64_t total;
+    uint32_t min;
+    uint32_t max;
+    uint32_t last;          // cycle count at the previous row
+} profile_period_t;
+
+#if PROFILE
+
+#include "cycles.h"
+
+extern profile_stat_t profile_stats[PROFILE_SECTIONS];
+extern const char *const profile_names[PROFILE_SECTIONS];
+extern profile_period_t profile_row_period;
+extern uint32_t profile_high_water;
+
+static inline void profile_record(profile_section_t section, uint32_t cycles)
+{
+    profile_stat_t *stat = &profile_stats[section];
+    stat->calls++;
+    stat->cycles += cycles;
+    if (cycles > stat->max) {
+        stat->max = cycles;
+    }
+}
+
+/**
+ * time between scan rows, called at the start of every row
+ */
+void profile_row();
+
+/**
+ * clear every counter, the next report covers the time since
+ */
+void profile_reset();
+
+// charges the rest of the enclosing scope to a section
+class ProfileScope {
+public:
+    ProfileScope(profile_section_t section) : section(section), start(cycles_now()) {}
+    ~ProfileScope() { profile_record(section, cycles_now() - start); }
+
+private:
+    profile_section_t section;
+    uint32_t start;
+};
+
+#define PROFILE_SCOPE(section)      ProfileScope profile_scope(section)
+#define PROFILE_ROW()               profile_row()
+#define PROFILE_LEVEL(level)        do { if ((level) > profile_high_water) profile_high_water = (level); } while (0)
+
+#else
+
+#define PROFILE_SCOPE(section)
+#define PROFILE_ROW()
+#define PROFILE_LEVEL(level)
+
+#endif
+
+#endif
@@ -0,0 +1,365 @@
+/*
+ * Copyright (C) 2017 David McKelvie.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <Arduino.h>
+#include <HardwareTimer.h>
+#include <libmaple/dma.h>
+#include <libmaple/timer.h>
+#include "LEDMatrix.h"
+#include "Profile.h"
+#include "ScanEngine.h"
+
+#define SCAN_DMA_CHANNEL    DMA_CH4     // TIM1_CH4 request
+#define MAX_COLUMNS         256         // repetition counter is 8 bits
+#define MAX_ROWS            16          // four address lines
+#define MIN_TICKS           4           // clock high, low and the DMA request in between
+#define OE_MIN_TICKS        8           // shortest OE pulse, about 110ns for the column drivers
+
+ScanEngine *ScanEngine::active = 0;
+
+// (level / 255) ^ 2.2 * 65535
+static const uint16_t gammaTable[256] = {
+        0,     1,     2,     4,     7,    11,    17,    24,
+       32,    42,    53,    65,    79,    94,   111,   129,
+      148,   169,   192,   216,   242,   270,   299,   330,
+      362,   396,   432,   469,   508,   549,   591,   635,
+      681,   729,   779,   830,   883,   938,   995,  1053,
+     1113,  1175,  1239,  1305,  1373,  1443,  1514,  1587,
+     1663,  1740,  1819,  1900,  1983,  2068,  2155,  2243,
+     2334,  2427,  2521,  2618,  2717,  2817,  2920,  3024,
+     3131,  3240,  3350,  3463,  3578,  3694,  3813,  3934,
+     4057,  4182,  4309,  4438,  4570,  4703,  4838,  4976,
+     5115,  5257,  5401,  5547,  5695,  5845,  5998,  6152,
+     6309,  6468,  6629,  6792,  6957,  7124,  7294,  7466,
+     7640,  7816,  7994,  8175,  8358,  8543,  8730,  8919,
+     9111,  9305,  9501,  9699,  9900, 10102, 10307, 10515,
+    10724, 10936, 11150, 11366, 11585, 11806, 12029, 12254,
+    12482, 12712, 12944, 13179, 13416, 13655, 13896, 14140,
+    14386, 14635, 14885, 15138, 15394, 15652, 15912, 16174,
+    16439, 16706, 16975, 17247, 17521, 17798, 18077, 18358,
+    18642, 18928, 19216, 19507, 19800, 20095, 20393, 20694,
+    20996, 21301, 21609, 21919, 22231, 22546, 22863, 23182,
+    23504, 23829, 24156, 24485, 24817, 25151, 25487, 25826,
+    26168, 26512, 26858, 27207, 27558, 27912, 28268, 28627,
+    28988, 29351, 29717, 30086, 30457, 30830, 31206, 31585,
+    31966, 32349, 32735, 33124, 33514, 33908, 34304, 34702,
+    35103, 35507, 35913, 36321, 36732, 37146, 37562, 37981,
+    38402, 38825, 39252, 39680, 40112, 40546, 40982, 41421,
+    41862, 42306, 42753, 43202, 43654, 44108, 44565, 45025,
+    45487, 45951, 46418, 46888, 47360, 47835, 48313, 48793,
+    49275, 49761, 50249, 50739, 51232, 51728, 52226, 52727,
+    53230, 53736, 54245, 54756, 55270, 55787, 56306, 56828,
+    57352, 57879, 58409, 58941, 59476, 60014, 60554, 61097,
+    61642, 62190, 62741, 63295, 63851, 64410, 64971, 65535
+};
+
+static uint32_t bsrrWord(uint8_t pin, uint8_t level)
+{
+    uint32_t bit = digitalPinToBitMask(pin);
+    return level ? bit : bit << 16;
+}
+
+ScanEngine::ScanEngine(HardwareTimer &timer, HardwareTimer &oeTimer) : timer(timer), oeTimer(oeTimer)
+{
+    matrix = 0;
+    ticks = 0;
+    level = 255;
+    onTicks = 0;
+    oeShift = 0;
+    stretch = 1;
+    nextStretch = 1;
+    skipped = 0;
+    row = 0;
+    plane = 0;
+    running = 0;
+    frameCount = 0;
+}
+
+bool ScanEngine::begin(LEDMatrix *matrix, uint8_t ticks)
+{
+    if (!matrix->scanbuf || matrix->columns() == 0 || matrix->columns() > MAX_COLUMNS ||
+        matrix->rows() > MAX_ROWS || ticks < MIN_TICKS) {
+        return false;
+    }
+    // OE has to be an output of the oe timer, and TIM1 is ITR0 of TIM2 to TIM4
+    if (PIN_MAP[matrix->oe].timer_device != oeTimer.c_dev() || !PIN_MAP[matrix->oe].timer_channel ||
+        oeTimer.c_dev() == timer.c_dev()) {
+        return false;
+    }
+
+    this->matrix = matrix;
+    this->ticks = ticks;
+    active = this;
+    updateOnTime();
+
+    port = digitalPinToPort(matrix->r1)->regs;
+    addressPort = digitalPinToPort(matrix->a)->regs;
+    latBit = digitalPinToBitMask(matrix->stb);
+
+    for (uint8_t r = 0; r < matrix->rows(); r++) {
+        address[r] = bsrrWord(matrix->a, r & 0x01) |
+                     bsrrWord(matrix->b, r & 0x02) |
+                     bsrrWord(matrix->c, r & 0x04) |
+                     bsrrWord(matrix->d, r & 0x08);
+    }
+
+    timer_dev *dev = timer.c_dev();
+    regs = dev->regs.adv;
+    oeDev = oeTimer.c_dev();
+    oeChannel = PIN_MAP[matrix->oe].timer_channel;
+
+    timer.pause();
+    timer.setPrescaleFactor(1);
+    oeTimer.pause();
+    oeTimer.setPrescaleFactor(1);
+    oeShift = 0;
+
+    // CH3N follows OC3REF when CH3 itself is disabled, PWM mode 2 keeps the
+    // clock low for the first half of the period and low again once stopped.
+    // No preload, the period is changed while the timer is stopped between planes.
+    timer_oc_set_mode(dev, 3, TIMER_OC_MODE_PWM_2, 0);
+    regs->CCER |= TIMER_CCER_CC3NE;
+    regs->BDTR |= TIMER_BDTR_MOE;
+
+    // the oe timer starts when TIM1 does and runs one pulse, OE is active
+    // low from CNT reaching the compare until the timer stops at ARR
+    timer_oc_set_mode(oeDev, oeChannel, TIMER_OC_MODE_PWM_2, 0);
+    timer_cc_set_pol(oeDev, oeChannel, 1);
+    timer_cc_enable(oeDev, oeChannel);
+    oeDev->regs.gen->CR1 |= TIMER_CR1_OPM;
+    oeDev->regs.gen->SMCR = TIMER_SMCR_TS_ITR0 | TIMER_SMCR_SMS_TRIGGER;
+    regs->CR2 = (regs->CR2 & ~TIMER_CR2_MMS) | TIMER_CR2_MMS_ENABLE;
+    setPeriod(0, 1);
+    timer_generate_update(oeDev);
+
+    // stop after columns() periods, UG loads the repetition counter
+    regs->RCR = matrix->columns() - 1;
+    regs->CR1 |= TIMER_CR1_OPM;
+    timer_generate_update(dev);
+    regs->SR = 0;
+
+    gpio_set_mode(digitalPinToPort(matrix->clk), PIN_MAP[matrix->clk].gpio_bit, GPIO_AF_OUTPUT_PP);
+    gpio_set_mode(digitalPinToPort(matrix->oe), PIN_MAP[matrix->oe].gpio_bit, GPIO_AF_OUTPUT_PP);
+
+    dma_init(DMA1);
+    dma_setup_transfer(DMA1, SCAN_DMA_CHANNEL, &port->ODR, DMA_SIZE_32BITS,
+                       matrix->scanbuf, DMA_SIZE_16BITS, DMA_MINC_MODE | DMA_FROM_MEM);
+    dma_set_priority(DMA1, SCAN_DMA_CHANNEL, DMA_PRIORITY_VERY_HIGH);
+    timer_dma_enable_req(dev, 4);
+
+    timer.attachInterrupt(TIMER_UPDATE_INTERRUPT, rowComplete);
+    return true;
+}
+
+void ScanEngine::start()
+{
+    if (!matrix || running) {
+        return;
+    }
+
+    running = 1;
+    row = 0;
+    plane = 0;
+    skipped = 0;
+    setQuiet(0);
+    setPeriod(0, 1);
+    shift(row, plane);
+}
+
+void ScanEngine::stop()
+{
+    running = 0;
+}
+
+uint32_t ScanEngine::frames()
+{
+    return frameCount;
+}
+
+void ScanEngine::setBrightness(uint8_t level)
+{
+    this->level = level;
+    updateOnTime();                     // picked up from the next row
+}
+
+uint8_t ScanEngine::brightness()
+{
+    return level;
+}
+
+void ScanEngine::setSlowdown(uint8_t factor)
+{
+    if (!matrix) {
+        return;
+    }
+
+    // the longest plane's period has to fit ARR
+    uint32_t limit = 65535UL / ((uint32_t) ticks << (matrix->planes() - 1));
+    if (factor > limit) {
+        factor = limit;
+    }
+    nextStretch = factor ? factor : 1;      // picked up from the next frame
+}
+
+uint8_t ScanEngine::slowdown()
+{
+    return nextStretch;
+}
+
+uint32_t ScanEngine::refreshRate()
+{
+    if (!matrix) {
+        return 0;
+    }
+    return F_CPU / ((uint32_t) ticks * ((1UL << matrix->planes()) - 1) * matrix->columns() * matrix->rows());
+}
+
+// lit ticks of a plane 0 row at the full rate, a gamma corrected share of
+// the row less one clock period. The levels whose share is under
+// OE_MIN_TICKS all get the shortest pulse. Above it each level gets at least
+// a tick more than the level below, where the curve rises slower than that.
+void ScanEngine::updateOnTime()
+{
+    if (!matrix) {
+        return;
+    }
+
+    uint32_t row = (uint32_t) ticks * (matrix->columns() - 1);
+    uint32_t on = 0;
+    for (uint16_t step = 1; step <= level; step++) {
+        uint32_t curve = (row * gammaTable[step] + 0x8000) >> 16;
+        if (curve <= OE_MIN_TICKS) {
+            on = OE_MIN_TICKS;
+        } else {
+            on = curve > on ? curve : on + 1;
+        }
+    }
+    onTicks = on < row ? on : row;
+}
+
+void ScanEngine::setPeriod(uint8_t plane, uint8_t lit)
+{
+    // slowed down, the period and its lit share stretch together
+    uint16_t period = (ticks << plane) * stretch;
+    regs->ARR = period - 1;
+    regs->CCR3 = period / 2;
+    regs->CCR4 = period / 4;                // data settles before the rising edge
+
+    // the oe timer counts in powers of two of 72MHz ticks, the fewest that
+    // fit the whole row in 16 bits
+    uint32_t row = (uint32_t) period * matrix->columns();
+    uint8_t shift = 0;
+    while ((row >> shift) > 0xffff) {
+        shift++;
+    }
+    if (shift != oeShift) {
+        oeShift = shift;
+        timer_set_prescaler(oeDev, (1 << shift) - 1);
+        timer_generate_update(oeDev);       // PSC is only loaded on an update
+    }
+
+    // OE low from the first oe tick for on oe ticks, ending before TIM1
+    // stops to latch. Dark rows compare past ARR and never go low.
+    uint32_t on = 0;
+    if (lit && matrix->state) {
+        on = ((uint32_t) onTicks * stretch << plane) >> shift;
+    }
+    if (on) {
+        timer_set_reload(oeDev, on);
+        timer_set_compare(oeDev, oeChannel, 1);
+    } else {
+        timer_set_reload(oeDev, 1);
+        timer_set_compare(oeDev, oeChannel, 2);
+    }
+}
+
+// a blank row holds the clock low and makes no DMA requests while it is timed
+void ScanEngine::setQuiet(uint8_t quiet)
+{
+    timer_dev *dev = timer.c_dev();
+
+    if (quiet) {
+        timer_dma_disable_req(dev, 4);
+        timer_oc_set_mode(dev, 3, TIMER_OC_MODE_FORCE_INACTIVE, 0);
+    } else {
+        timer_oc_set_mode(dev, 3, TIMER_OC_MODE_PWM_2, 0);
+        timer_dma_enable_req(dev, 4);
+    }
+}
+
+void ScanEngine::shift(uint8_t row, uint8_t plane)
+{
+    uint16_t columns = matrix->columns();
+    uint16_t *words = matrix->scanbuf + (plane * matrix->rows() + row) * columns;
+
+    dma_disable(DMA1, SCAN_DMA_CHANNEL);
+    dma_set_mem_addr(DMA1, SCAN_DMA_CHANNEL, words);
+    dma_set_num_transfers(DMA1, SCAN_DMA_CHANNEL, columns);
+    dma_enable(DMA1, SCAN_DMA_CHANNEL);
+
+    regs->CR1 |= TIMER_CR1_CEN;
+}
+
+// TIM1 update, a row's plane has been shifted in and the timer has stopped
+void ScanEngine::rowComplete()
+{
+    PROFILE_ROW();
+    PROFILE_SCOPE(PROFILE_SCAN_ROW);
+
+    ScanEngine *engine = active;
+    gpio_reg_map *port = engine->port;
+
+    // the oe timer stopped before TIM1 with OE high, the display is off
+    PORT_WRITE(&engine->addressPort->BSRR, engine->address[engine->row]);
+
+    PORT_WRITE(&port->BSRR, engine->latBit);            // latch data
+    PORT_WRITE(&port->BRR, engine->latBit);
+
+    if (!engine->running) {
+        return;                                         // leave display disabled
+    }
+
+    // the plane just latched is on, for its share of the row, while the
+    // next one shifts in. After a blank row whatever was left in the
+    // shift registers has been latched, it stays dark.
+    engine->setPeriod(engine->plane, !engine->skipped);
+
+    uint8_t plane = engine->plane + 1;
+    uint8_t row = engine->row;
+    if (plane == engine->matrix->planes()) {
+        plane = 0;
+        row++;
+        if (row == engine->matrix->rows()) {
+            row = 0;
+            engine->frameCount++;
+            engine->matrix->frameComplete();
+            engine->stretch = engine->nextStretch;
+        }
+    }
+    engine->plane = plane;
+    engine->row = row;
+
+    uint8_t blank = (engine->matrix->blank >> row) & 1;
+    if (blank != engine->skipped) {
+        engine->setQuiet(blank);
+        engine->skipped = blank;
+    }
+    if (blank) {
+        engine->regs->CR1 |= TIMER_CR1_CEN;             // time the row, shift nothing
+    } else {
+        engine->shift(row, plane);
+    }
+}
@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2017 David McKelvie.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SCAN_ENGINE_H__
+#define __SCAN_ENGINE_H__
+
+#include <stdint.h>
+
+class HardwareTimer;
+class LEDMatrix;
+struct gpio_reg_map;
+struct timer_adv_reg_map;
+struct timer_dev;
+
+/**
+ * Refresh an LEDMatrix from its scan buffer using TIM1 and DMA, so the
+ * refresh rate no longer depends on what loop() is doing.
+ *
+ * TIM1 generates the shift clock on CH3N (PB15) and raises a DMA request on
+ * compare 4 once per clock period. DMA1 channel 4 copies the next port word
+ * from the scan buffer into the colour port's ODR ahead of each rising edge.
+ * One pulse mode plus the repetition counter stop the timer after exactly
+ * columns() clocks, the update interrupt then latches the row, selects its
+ * address and starts shifting the next one.
+ *
+ * With more than one bit plane each row is shifted once per plane. The
+ * clock period used while a plane is on show is doubled for every plane
+ * weight, so plane n stays latched for 2^n times as long as plane 0 and
+ * the weighting comes from the timer rather than the CPU. The refresh rate
+ * is 72MHz / (ticks * (2^planes - 1) * columns() * rows()).
+ *
+ * OE is driven by a second timer, the one whose channel is on the oe pin.
+ * It is a trigger mode slave of TIM1, so it starts as each row starts
+ * shifting and runs a single pulse: OE goes low one tick in and high again
+ * when the pulse ends, before TIM1 stops to latch the row. Brightness sets
+ * the pulse through a gamma table as a share of the whole row time with no
+ * CPU involved, the same share for every row and each plane's weight. The
+ * shortest pulse is 8 ticks, about 110ns. The dimmest levels, whose share is
+ * shorter, all show that, above it every level is brighter than the last.
+ *
+ * A scan row with nothing lit is not shifted at all. The timer still runs
+ * for the row's time with the clock held low, no DMA and OE high, so the
+ * other rows keep their share and brightness does not depend on content.
+ * setSlowdown() stretches every period by a whole factor for lower power
+ * once the picture is still, the lit share stretches with it.
+ *
+ * Requirements:
+ *   - clk on PB15, the timer passed in must be Timer1
+ *   - oe on a channel of oeTimer, which is Timer2, 3 or 4 as TIM1 is their
+ *     ITR0, e.g. PB0 on Timer3 channel 3
+ *   - colour pins and stb on the same port, the whole port's ODR is written
+ *   - a, b, c and d on the same port
+ *   - columns() no more than 256 (8 bit repetition counter)
+ */
+class ScanEngine {
+public:
+    ScanEngine(HardwareTimer &timer, HardwareTimer &oeTimer);
+
+    /**
+     * configure the timer and DMA channel, the matrix must already have a scan buffer
+     * @param matrix    matrix to refresh
+     * @param ticks     shift clock period in 72MHz timer ticks, at least 4
+     * @return false, with nothing configured and start() doing nothing, if
+     *         there is no scan buffer, the matrix has no columns or more than
+     *         256, more than 16 rows, ticks is below 4 or oe is not an output
+     *         of oeTimer
+     */
+    bool begin(LEDMatrix *matrix, uint8_t ticks = 12);
+
+    void start();
+
+    /**
+     * stop after the current row, leaving the display disabled
+     */
+    void stop();
+
+    /**
+     * number of complete refreshes since begin()
+     */
+    uint32_t frames();
+
+    /**
+     * display brightness, gamma corrected so equal steps look equal
+     * @param level     0 dark to 255 full
+     */
+    void setBrightness(uint8_t level);
+
+    uint8_t brightness();
+
+    /**
+     * refresh at 1 / factor of the full rate from the next frame, without
+     * changing brightness. Limited to what the 16 bit timer can time.
+     * @param factor    1 for the full rate
+     */
+    void setSlowdown(uint8_t factor);
+
+    uint8_t slowdown();
+
+    /**
+     * refreshes per second at the full rate
+     */
+    uint32_t refreshRate();
+
+private:
+    static void rowComplete();
+    void updateOnTime();
+    void setPeriod(uint8_t plane, uint8_t lit);
+    void setQuiet(uint8_t quiet);
+    void shift(uint8_t row, uint8_t plane);
+
+    static ScanEngine *active;
+
+    HardwareTimer &timer;
+    HardwareTimer &oeTimer;
+    LEDMatrix *matrix;
+    gpio_reg_map *port;
+    gpio_reg_map *addressPort;
+    timer_adv_reg_map *regs;
+    timer_dev *oeDev;
+    uint8_t oeChannel;
+    uint8_t oeShift;            // oe timer prescaler is 2^oeShift
+    uint32_t address[16];   // BSRR words selecting each row
+    uint16_t latBit;
+    uint8_t ticks;
+    uint8_t level;
+    uint8_t stretch;            // slowdown of the frame being shown
+    volatile uint8_t nextStretch;
+    volatile uint8_t skipped;   // the row being timed was blank, nothing shifted
+    volatile uint16_t onTicks;  // OE low per plane 0 row at the full rate
+    volatile uint8_t row;
+    volatile uint8_t plane;
+    volatile uint8_t running;
+    volatile uint32_t frameCount;
+};
+
+#endif
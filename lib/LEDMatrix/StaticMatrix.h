@@ -0,0 +1,239 @@
+/*
+ * Copyright (C) 2017 David McKelvie.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __STATIC_MATRIX_H__
+#define __STATIC_MATRIX_H__
+
+#include <string.h>
+#include "LEDMatrix.h"
+
+/**
+ * An LEDMatrix whose geometry is fixed when it is compiled. The panel is
+ * Width x Height pixels of ModuleHeight row modules lighting ScanRows rows
+ * at a time, chained in full width rows with the top row shifted first,
+ * showing a CanvasWidth x CanvasHeight canvas.
+ *
+ * Geometry is checked by static_assert rather than the runtime ASSERT, buffer
+ * sizes are constants and encoding a scan row runs loops with constant trip
+ * counts over constant strides, which the compiler can unroll. drawPoint(),
+ * clear() and the viewport lookup use the constant canvas stride too. The
+ * rest of drawing, viewports and the scan engine are shared with LEDMatrix.
+ */
+template <uint16_t Width, uint16_t Height, uint8_t ScanRows, uint8_t ModuleHeight = 2 * ScanRows,
+          uint16_t CanvasWidth = Width, uint16_t CanvasHeight = Height>
+class StaticMatrix : public LEDMatrix {
+public:
+    static_assert(Width > 0 && 0 == (Width % 32), "Width must be a multiple of 32");
+    static_assert(ScanRows > 0 && ScanRows <= 16, "A to D select at most 16 scan rows");
+    static_assert(0 == (ModuleHeight % (2 * ScanRows)), "ModuleHeight must be a multiple of 2 * ScanRows");
+    static_assert(Height > 0 && 0 == (Height % ModuleHeight), "Height must be whole modules");
+    static_assert(Width * (Height / ScanRows / 2) <= MAX_CHAIN, "the scan engine's repetition counter is 8 bits");
+    static_assert(0 == (CanvasWidth % 8) && CanvasWidth >= Width && CanvasHeight >= Height,
+                  "the canvas must be whole bytes wide and cover the panel");
+
+    static const uint16_t Stride = Width / 8;                   // display buffer bytes per row
+    static const uint8_t  Lines = Height / ModuleHeight;         // rows of modules
+    static const uint8_t  Blocks = ModuleHeight / (2 * ScanRows); // module rows per scan row and half
+    static const uint16_t Columns = Width * Lines * Blocks;     // columns()
+    static const uint16_t DisplayBytes = Stride * Height;
+    static const uint16_t CanvasStride = CanvasWidth / 8;        // canvas bytes per row
+    static const uint16_t CanvasBytes = CanvasStride * CanvasHeight;
+
+    static_assert(Lines * Blocks <= MAX_SEGMENTS, "too many module rows for the segment table");
+
+    /**
+     * port words in a scan buffer with depth bit planes
+     */
+    static constexpr uint32_t scanWords(uint8_t depth)
+    {
+        return (uint32_t) depth * ScanRows * Columns;
+    }
+
+    StaticMatrix(uint8_t a, uint8_t b, uint8_t c, uint8_t d, uint8_t oe, uint8_t r1, uint8_t r2, uint8_t stb, uint8_t clk)
+        : LEDMatrix(a, b, c, d, oe, r1, r2, stb, clk)
+    {
+    }
+
+    StaticMatrix(uint8_t a, uint8_t b, uint8_t c, uint8_t d, uint8_t oe, uint8_t stb, uint8_t clk, uint8_t r1, uint8_t r2,
+                 uint8_t g1, uint8_t g2, uint8_t b1, uint8_t b2)
+        : LEDMatrix(a, b, c, d, oe, stb, clk, r1, r2, g1, g2, b1, b2)
+    {
+    }
+
+    /**
+     * @param displaybuf    CanvasBytes
+     */
+    void begin(uint8_t *displaybuf)
+    {
+        LEDMatrix::begin(displaybuf, Width, Height);
+        LEDMatrix::setCanvas(CanvasWidth, CanvasHeight);
+        layout();
+    }
+
+    /**
+     * double buffered begin, see LEDMatrix::begin(), CanvasBytes each
+     */
+    void begin(uint8_t *front, uint8_t *back)
+    {
+        LEDMatrix::begin(front, back, Width, Height);
+        LEDMatrix::setCanvas(CanvasWidth, CanvasHeight);
+        layout();
+    }
+
+    /**
+     * LEDMatrix::drawPoint() with the canvas stride fixed
+     */
+    void drawPoint(uint16_t x, uint16_t y, uint8_t pixel) final
+    {
+        uint8_t *byte = displaybuf + x / 8 + y * CanvasStride;
+        uint8_t  bit = x % 8;
+
+        touch(y, y + 1);
+
+        if (pixel) {
+            *byte |= 0x80 >> bit;
+        } else {
+            *byte &= ~(0x80 >> bit);
+        }
+    }
+
+    /**
+     * LEDMatrix::clear() over the fixed canvas size
+     */
+    void clear() final
+    {
+        memset(displaybuf, 0x00, CanvasBytes);
+        touch(0, CanvasHeight);
+    }
+
+    /**
+     * arrange the modules some other way, they keep ModuleHeight and
+     * ScanRows so rows() and columns() do not change. Encoding goes back
+     * to walking the tile map.
+     * @return false if LEDMatrix::setTileMap() refused the map
+     */
+    bool setTileMap(const MatrixTile *tiles, uint8_t count, uint16_t moduleWidth)
+    {
+        if (!LEDMatrix::setTileMap(tiles, count, moduleWidth, ModuleHeight, ScanRows)) {
+            return false;
+        }
+        encoder = 0;
+        return true;
+    }
+
+    using LEDMatrix::scan;
+
+    /**
+     * LEDMatrix::scan() with the shift loops sized at compile time
+     */
+    template <uint8_t CLK, uint8_t R1, uint8_t R2>
+    void scan();
+
+private:
+    // the canvas is fixed, and the modules keep ModuleHeight and ScanRows
+    using LEDMatrix::setCanvas;
+    using LEDMatrix::setTileMap;
+
+    const uint8_t *viewRow(const uint8_t *source, uint16_t y, uint16_t *x) final
+    {
+        uint16_t row;
+        *x = viewAt(y, &row)->x;
+        return source + row * CanvasStride;
+    }
+
+    void layout()
+    {
+        // the full width rows begin() lays out, with this module size
+        MatrixTile tiles[Lines];
+        for (uint8_t line = 0; line < Lines; line++) {
+            tiles[line].x = 0;
+            tiles[line].y = (Lines - 1 - line) * ModuleHeight;
+            tiles[line].rotation = TILE_ROTATE_0;
+        }
+        LEDMatrix::setTileMap(tiles, Lines, Width, ModuleHeight, ScanRows);
+        encoder = encode;
+    }
+
+    // top and bottom pixel bytes for the shift positions of one scan row
+    template <typename Emit>
+    inline void shiftFixed(uint8_t row, const uint8_t *source, Emit emit)
+    {
+        for (uint8_t line = 0; line < Lines; line++) {
+            for (uint8_t block = 0; block < Blocks; block++) {
+                uint16_t y = line * ModuleHeight + block * ScanRows + row;
+                uint16_t ux, lx;
+                const uint8_t *upper = viewRow(source, y, &ux);
+                const uint8_t *lower = viewRow(source, y + ModuleHeight / 2, &lx);
+
+                for (uint16_t byte = 0; byte < Stride; byte++) {
+                    emit(canvasByte(upper, ux) ^ mask, canvasByte(lower, lx) ^ mask);
+                    ux = nextByte(ux);
+                    lx = nextByte(lx);
+                }
+            }
+        }
+    }
+
+    static void encode(LEDMatrix *matrix, uint8_t row, const uint8_t *source, uint16_t *word, uint16_t base)
+    {
+        StaticMatrix *self = static_cast<StaticMatrix *>(matrix);
+        const uint16_t *colour = self->colourWord;
+
+        self->shiftFixed(row, source, [&word, base, colour](uint8_t top, uint8_t bottom) {
+            word[0] = base | colour[((top >> 6) & 0x02) | (bottom >> 7)];
+            word[1] = base | colour[((top >> 5) & 0x02) | ((bottom >> 6) & 0x01)];
+            word[2] = base | colour[((top >> 4) & 0x02) | ((bottom >> 5) & 0x01)];
+            word[3] = base | colour[((top >> 3) & 0x02) | ((bottom >> 4) & 0x01)];
+            word[4] = base | colour[((top >> 2) & 0x02) | ((bottom >> 3) & 0x01)];
+            word[5] = base | colour[((top >> 1) & 0x02) | ((bottom >> 2) & 0x01)];
+            word[6] = base | colour[(top & 0x02) | ((bottom >> 1) & 0x01)];
+            word[7] = base | colour[((top << 1) & 0x02) | (bottom & 0x01)];
+            word += 8;
+        });
+    }
+};
+
+template <uint16_t Width, uint16_t Height, uint8_t ScanRows, uint8_t ModuleHeight,
+          uint16_t CanvasWidth, uint16_t CanvasHeight>
+template <uint8_t CLK, uint8_t R1, uint8_t R2>
+void StaticMatrix<Width, Height, ScanRows, ModuleHeight, CanvasWidth, CanvasHeight>::scan()
+{
+    static_assert(FastPin<CLK>::port == FastPin<R1>::port && FastPin<CLK>::port == FastPin<R2>::port,
+                  "CLK, R1 and R2 must be on the same port");
+
+    if (!encoder) {
+        LEDMatrix::scan<CLK, R1, R2>();
+        return;
+    }
+    if (!state) {
+        return;
+    }
+
+    volatile uint32_t *bsrr = &FastPin<CLK>::bsrr();
+
+    shiftFixed(scanRow, page ? page : frontbuf, [bsrr](uint8_t top, uint8_t bottom) {
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            PORT_WRITE(bsrr, FastPin<CLK>::word(0) |
+                             FastPin<R1>::word(top & (0x80 >> bit)) |
+                             FastPin<R2>::word(bottom & (0x80 >> bit)));
+            PORT_WRITE(bsrr, FastPin<CLK>::word(1));
+        }
+    });
+
+    latchRow();
+}
+
+#endif
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2017 David McKelvie.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CYCLES_H__
+#define __CYCLES_H__
+#include <stdint.h>
+
+#ifdef NATIVE_HAL
+#include <NativeHal.h>
+
+// host builds count 72MHz ticks of the monotonic clock
+static inline void cycles_begin()
+{
+}
+
+static inline uint32_t cycles_now()
+{
+  return native_cycles();
+}
+
+#else
+
+// Cortex-M3 DWT cycle counter, counts 72MHz core clocks and wraps every ~60s
+#define DEMCR           (*(volatile uint32_t *)0xE000EDFC)
+#define DEMCR_TRCENA    (1UL << 24)
+#define DWT_CTRL        (*(volatile uint32_t *)0xE0001000)
+#define DWT_CYCCNTENA   (1UL << 0)
+#define DWT_CYCCNT      (*(volatile uint32_t *)0xE0001004)
+
+static inline void cycles_begin()
+{
+  DEMCR |= DEMCR_TRCENA;
+  DWT_CYCCNT = 0;
+  DWT_CTRL |= DWT_CYCCNTENA;
+}
+
+static inline uint32_t cycles_now()
+{
+  return DWT_CYCCNT;
+}
+
+#endif
+
+#endif /* __CYCLES_H__ */
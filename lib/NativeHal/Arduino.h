@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2017 David McKelvie.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __ARDUINO_H__
+#define __ARDUINO_H__
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include "NativeHal.h"
+
+// the subset of the stm32duino (libmaple) core used by the sign
+
+typedef uint8_t  uint8;
+typedef uint16_t uint16;
+typedef uint32_t uint32;
+typedef uint8_t  byte;
+#define __io volatile
+
+#define F_CPU   72000000L
+
+#define HIGH    0x1
+#define LOW     0x0
+#define BIT(shift)  (1UL << (shift))
+
+typedef enum WiringPinMode {
+    OUTPUT,
+    OUTPUT_OPEN_DRAIN,
+    INPUT,
+    INPUT_ANALOG,
+    INPUT_PULLUP,
+    INPUT_PULLDOWN,
+    INPUT_FLOATING,
+    PWM,
+    PWM_OPEN_DRAIN,
+} WiringPinMode;
+
+typedef struct gpio_reg_map {
+    __io uint32 CRL;
+    __io uint32 CRH;
+    __io uint32 IDR;
+    __io uint32 ODR;
+    __io uint32 BSRR;
+    __io uint32 BRR;
+    __io uint32 LCKR;
+} gpio_reg_map;
+
+typedef struct gpio_dev {
+    gpio_reg_map *regs;
+} gpio_dev;
+
+extern gpio_dev *const GPIOA;
+extern gpio_dev *const GPIOB;
+extern gpio_dev *const GPIOC;
+
+typedef enum gpio_pin_mode {
+    GPIO_OUTPUT_PP,
+    GPIO_OUTPUT_OD,
+    GPIO_AF_OUTPUT_PP,
+    GPIO_AF_OUTPUT_OD,
+    GPIO_INPUT_ANALOG,
+    GPIO_INPUT_FLOATING,
+    GPIO_INPUT_PD,
+    GPIO_INPUT_PU,
+} gpio_pin_mode;
+
+void gpio_set_mode(gpio_dev *dev, uint8 pin, gpio_pin_mode mode);
+
+struct timer_dev;
+
+typedef struct stm32_pin_info {
+    gpio_dev *gpio_device;
+    timer_dev *timer_device;
+    uint8 gpio_bit;
+    uint8 timer_channel;
+} stm32_pin_info;
+
+// generic STM32F103C numbering
+enum {
+    PA0, PA1, PA2, PA3, PA4, PA5, PA6, PA7, PA8, PA9, PA10, PA11, PA12, PA13, PA14, PA15,
+    PB0, PB1, PB2, PB3, PB4, PB5, PB6, PB7, PB8, PB9, PB10, PB11, PB12, PB13, PB14, PB15,
+    PC13, PC14, PC15, BOARD_NR_GPIO_PINS
+};
+
+extern const stm32_pin_info PIN_MAP[BOARD_NR_GPIO_PINS];
+
+#define digitalPinToPort(pin)       (PIN_MAP[pin].gpio_device)
+#define digitalPinToBitMask(pin)    (BIT(PIN_MAP[pin].gpio_bit))
+#define portSetRegister(pin)        (&(PIN_MAP[pin].gpio_device->regs->BSRR))
+#define portClearRegister(pin)      (&(PIN_MAP[pin].gpio_device->regs->BRR))
+
+void pinMode(uint8 pin, WiringPinMode mode);
+void digitalWrite(uint8 pin, uint8 value);
+uint32 digitalRead(uint8 pin);
+
+// the host has no interrupts to mask, handlers run from the simulation loop
+static inline void noInterrupts() {}
+static inline void interrupts() {}
+
+uint32 millis();
+uint32 micros();
+void delay(uint32 ms);
+void delayMicroseconds(uint32 us);
+
+class String {
+public:
+    String(const char *text = "") : text(text) {}
+    const char *c_str() const { return text.c_str(); }
+    unsigned int length() const { return text.length(); }
+    char charAt(unsigned int index) const { return text[index]; }
+
+private:
+    std::string text;
+};
+
+#define DEC 10
+#define HEX 16
+
+// Serial goes to stdout
+class HostSerial {
+public:
+    void begin(uint32 baud);
+    size_t write(uint8 c);
+    size_t print(const char *text);
+    size_t print(const String &text);
+    size_t print(char c);
+    size_t print(long value, int base = DEC);
+    size_t print(unsigned long value, int base = DEC);
+    size_t print(int value, int base = DEC);
+    size_t print(unsigned int value, int base = DEC);
+    size_t println();
+    template <typename T> size_t println(T value)
+    {
+        return print(value) + println();
+    }
+    template <typename T> size_t println(T value, int base)
+    {
+        return print(value, base) + println();
+    }
+};
+
+extern HostSerial Serial;
+
+void setup();
+void loop();
+
+#endif
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2017 David McKelvie.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __HARDWARE_TIMER_H__
+#define __HARDWARE_TIMER_H__
+
+#include <Arduino.h>
+#include <libmaple/timer.h>
+
+typedef void (*voidFuncPtr)(void);
+
+#define TIMER_CH1               1
+#define TIMER_CH2               2
+#define TIMER_CH3               3
+#define TIMER_CH4               4
+
+class HardwareTimer {
+public:
+    HardwareTimer(uint8 timerNum);
+
+    void pause();
+    void resume();
+    uint32 getPrescaleFactor();
+    void setPrescaleFactor(uint32 factor);
+    uint16 getOverflow();
+    void setOverflow(uint16 val);
+    uint16 setPeriod(uint32 microseconds);
+    uint16 getCompare(int channel);
+    void setCompare(int channel, uint16 compare);
+    uint16 getCount();
+    void setCount(uint16 val);
+    void attachInterrupt(int channel, voidFuncPtr handler);
+    void detachInterrupt(int channel);
+    void refresh();
+    timer_dev *c_dev() { return dev; }
+
+private:
+    timer_dev *dev;
+};
+
+extern HardwareTimer Timer1;
+extern HardwareTimer Timer2;
+extern HardwareTimer Timer3;
+extern HardwareTimer Timer4;
+
+#endif
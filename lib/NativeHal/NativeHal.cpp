@@ -0,0 +1,993 @@
+/*
+ * Copyright (C) 2017 David McKelvie.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+#include <Arduino.h>
+#include <HardwareTimer.h>
+#include <SPI.h>
+#include <libmaple/dma.h>
+#include <libmaple/timer.h>
+#include "NativeHal.h"
+#include "Panel.h"
+
+#define GPIO_PORTS          3
+#define HW_GPIO_BASE        0x40010800UL    // where FastPin thinks GPIOA is
+#define HW_GPIO_STRIDE      0x400UL
+#define TIMERS              4
+#define DMA_CHANNELS        7
+#define SPI1_RX_DMA         DMA_CH2         // fixed request lines
+#define SPI1_TX_DMA         DMA_CH3
+
+#define FEED_BYTES          64      // SPI bytes delivered before each pass
+#define SETTLE_PASSES       4       // passes run after the last byte
+#define MAX_TICKS           4096    // update events allowed for one frame
+
+static Panel *panel = 0;
+
+// GPIO
+
+static gpio_reg_map gpioRegs[GPIO_PORTS];
+static gpio_dev gpioDevs[GPIO_PORTS] = {{&gpioRegs[0]}, {&gpioRegs[1]}, {&gpioRegs[2]}};
+gpio_dev *const GPIOA = &gpioDevs[0];
+gpio_dev *const GPIOB = &gpioDevs[1];
+gpio_dev *const GPIOC = &gpioDevs[2];
+
+static uint16_t altFunction[GPIO_PORTS];    // pins driven by a timer output
+static uint16_t timerOutput[GPIO_PORTS];    // and their levels
+
+// timers, defined before PIN_MAP which points at them
+
+static timer_adv_reg_map timerRegs[TIMERS];
+static timer_dev timerDevs[TIMERS] = {
+    {{&timerRegs[0]}, {0}}, {{&timerRegs[1]}, {0}}, {{&timerRegs[2]}, {0}}, {{&timerRegs[3]}, {0}},
+};
+timer_dev *const TIMER1 = &timerDevs[0];
+timer_dev *const TIMER2 = &timerDevs[1];
+timer_dev *const TIMER3 = &timerDevs[2];
+timer_dev *const TIMER4 = &timerDevs[3];
+
+static uint32 prescaled[TIMERS];    // TIM1 ticks counted towards the next CNT step
+static bool masterEnabled = false;  // TIM1's CEN as it last stopped, TRGO rises from 0
+
+// output pins for CH1-CH4 then CH1N-CH3N, only TIM1 has complementary outputs
+static const uint8_t timerPins[TIMERS][7] = {
+    {PA8, PA9, PA10, PA11, PB13, PB14, PB15},
+    {PA0, PA1, PA2, PA3, 0xff, 0xff, 0xff},
+    {PA6, PA7, PB0, PB1, 0xff, 0xff, 0xff},
+    {PB6, PB7, PB8, PB9, 0xff, 0xff, 0xff},
+};
+
+// DMA1 channel for the update then CH1-CH4 requests, 0 for none
+static const uint8_t timerDma[TIMERS][5] = {
+    {5, 2, 3, 6, 4},
+    {2, 5, 7, 1, 7},
+    {3, 6, 0, 2, 3},
+    {7, 1, 4, 5, 0},
+};
+
+#define PIN(port, bit)              {&gpioDevs[port], 0, bit, 0}
+#define TIMER_PIN(port, bit, t, ch) {&gpioDevs[port], &timerDevs[t], bit, ch}
+
+const stm32_pin_info PIN_MAP[BOARD_NR_GPIO_PINS] = {
+    TIMER_PIN(0, 0, 1, 1), TIMER_PIN(0, 1, 1, 2), TIMER_PIN(0, 2, 1, 3), TIMER_PIN(0, 3, 1, 4),
+    PIN(0, 4), PIN(0, 5), TIMER_PIN(0, 6, 2, 1), TIMER_PIN(0, 7, 2, 2),
+    TIMER_PIN(0, 8, 0, 1), TIMER_PIN(0, 9, 0, 2), TIMER_PIN(0, 10, 0, 3), TIMER_PIN(0, 11, 0, 4),
+    PIN(0, 12), PIN(0, 13), PIN(0, 14), PIN(0, 15),
+    TIMER_PIN(1, 0, 2, 3), TIMER_PIN(1, 1, 2, 4), PIN(1, 2), PIN(1, 3),
+    PIN(1, 4), PIN(1, 5), TIMER_PIN(1, 6, 3, 1), TIMER_PIN(1, 7, 3, 2),
+    TIMER_PIN(1, 8, 3, 3), TIMER_PIN(1, 9, 3, 4), PIN(1, 10), PIN(1, 11),
+    PIN(1, 12), PIN(1, 13), PIN(1, 14), PIN(1, 15),
+    PIN(2, 13), PIN(2, 14), PIN(2, 15),
+};
+
+static int portIndex(gpio_dev *dev)
+{
+    return dev - gpioDevs;
+}
+
+// which port a register belongs to, simulated or at its hardware address
+static int findPort(volatile uint32_t *reg, uintptr_t *offset)
+{
+    uintptr_t address = (uintptr_t) reg;
+
+    for (int i = 0; i < GPIO_PORTS; i++) {
+        uintptr_t base = (uintptr_t) &gpioRegs[i];
+        if (address >= base && address < base + sizeof(gpio_reg_map)) {
+            *offset = address - base;
+            return i;
+        }
+        base = HW_GPIO_BASE + i * HW_GPIO_STRIDE;
+        if (address >= base && address < base + sizeof(gpio_reg_map)) {
+            *offset = address - base;
+            return i;
+        }
+    }
+    return -1;
+}
+
+void native_attach(Panel *attach)
+{
+    panel = attach;
+}
+
+void native_port_write(volatile uint32_t *reg, uint32_t value)
+{
+    uintptr_t offset;
+    int index = findPort(reg, &offset);
+
+    if (index < 0) {
+        *reg = value;
+        return;
+    }
+
+    gpio_reg_map *port = &gpioRegs[index];
+    switch (offset) {
+        case offsetof(gpio_reg_map, ODR):
+        port->ODR = value & 0xffff;
+        break;
+
+        case offsetof(gpio_reg_map, BSRR):
+        // set wins over reset
+        port->ODR = ((port->ODR & ~(value >> 16)) | value) & 0xffff;
+        break;
+
+        case offsetof(gpio_reg_map, BRR):
+        port->ODR &= ~value & 0xffff;
+        break;
+
+        default:
+        *(volatile uint32_t *)((uint8_t *) port + offset) = value;
+        break;
+    }
+
+    if (panel) {
+        panel->store();
+    }
+}
+
+uint8_t native_pin(uint8_t pin)
+{
+    int index = portIndex(PIN_MAP[pin].gpio_device);
+    uint16_t bit = digitalPinToBitMask(pin);
+
+    if (altFunction[index] & bit) {
+        return (timerOutput[index] & bit) != 0;
+    }
+    return (gpioRegs[index].ODR & bit) != 0;
+}
+
+void gpio_set_mode(gpio_dev *dev, uint8 pin, gpio_pin_mode mode)
+{
+    int index = portIndex(dev);
+
+    if (mode == GPIO_AF_OUTPUT_PP || mode == GPIO_AF_OUTPUT_OD) {
+        altFunction[index] |= BIT(pin);
+    } else {
+        altFunction[index] &= ~BIT(pin);
+    }
+}
+
+void pinMode(uint8 pin, WiringPinMode mode)
+{
+    bool af = mode == PWM || mode == PWM_OPEN_DRAIN;
+    gpio_set_mode(PIN_MAP[pin].gpio_device, PIN_MAP[pin].gpio_bit,
+                  af ? GPIO_AF_OUTPUT_PP : GPIO_OUTPUT_PP);
+}
+
+void digitalWrite(uint8 pin, uint8 value)
+{
+    uint32_t bit = digitalPinToBitMask(pin);
+    native_port_write(portSetRegister(pin), value ? bit : bit << 16);
+}
+
+uint32 digitalRead(uint8 pin)
+{
+    return native_pin(pin);
+}
+
+// DMA1
+
+struct DmaChannel {
+    __io void *peripheral;
+    __io void *memory;
+    dma_xfer_size peripheralSize;
+    dma_xfer_size memorySize;
+    uint32 mode;
+    uint16 total;
+    uint16 count;
+    uint8 enabled;
+    dma_irq_cause cause;
+    void (*handler)(void);
+};
+
+struct dma_dev {
+    DmaChannel channels[DMA_CHANNELS];
+};
+
+static dma_dev dma1;
+dma_dev *const DMA1 = &dma1;
+
+static uint32_t readSized(__io void *address, dma_xfer_size size)
+{
+    switch (size) {
+        case DMA_SIZE_8BITS:  return *(__io uint8_t *) address;
+        case DMA_SIZE_16BITS: return *(__io uint16_t *) address;
+        default:              return *(__io uint32_t *) address;
+    }
+}
+
+static void writeSized(__io void *address, dma_xfer_size size, uint32_t value)
+{
+    switch (size) {
+        case DMA_SIZE_8BITS:  *(__io uint8_t *) address = value; break;
+        case DMA_SIZE_16BITS: *(__io uint16_t *) address = value; break;
+        default:              native_port_write((__io uint32_t *) address, value); break;
+    }
+}
+
+// one request from a peripheral, moves one item
+static void dmaRequest(uint8_t channel)
+{
+    if (!channel) {
+        return;
+    }
+
+    DmaChannel &ch = dma1.channels[channel - 1];
+    if (!ch.enabled || !ch.count) {
+        return;
+    }
+
+    uint16 done = ch.total - ch.count;
+    __io uint8_t *memory = (__io uint8_t *) ch.memory;
+    if (ch.mode & DMA_MINC_MODE) {
+        memory += done << ch.memorySize;
+    }
+
+    if (ch.mode & DMA_FROM_MEM) {
+        writeSized(ch.peripheral, ch.peripheralSize, readSized(memory, ch.memorySize));
+    } else {
+        writeSized(memory, ch.memorySize, readSized(ch.peripheral, ch.peripheralSize));
+    }
+    ch.count--;
+
+    if (ch.count == ch.total / 2 && (ch.mode & DMA_HALF_TRNS) && ch.handler) {
+        ch.cause = DMA_TRANSFER_HALF_COMPLETE;
+        ch.handler();
+    }
+    if (ch.count == 0) {
+        if (ch.mode & DMA_CIRC_MODE) {
+            ch.count = ch.total;
+        }
+        if ((ch.mode & DMA_TRNS_CMPLT) && ch.handler) {
+            ch.cause = DMA_TRANSFER_COMPLETE;
+            ch.handler();
+        }
+    }
+}
+
+void dma_init(dma_dev *dev)
+{
+}
+
+void dma_setup_transfer(dma_dev *dev, dma_channel channel,
+                        __io void *peripheral_address, dma_xfer_size peripheral_size,
+                        __io void *memory_address, dma_xfer_size memory_size,
+                        uint32 mode)
+{
+    DmaChannel &ch = dev->channels[channel - 1];
+    ch.peripheral = peripheral_address;
+    ch.peripheralSize = peripheral_size;
+    ch.memory = memory_address;
+    ch.memorySize = memory_size;
+    ch.mode = mode;
+    ch.enabled = 0;
+}
+
+void dma_set_num_transfers(dma_dev *dev, dma_channel channel, uint16 num_transfers)
+{
+    dev->channels[channel - 1].total = num_transfers;
+    dev->channels[channel - 1].count = num_transfers;
+}
+
+void dma_set_mem_addr(dma_dev *dev, dma_channel channel, __io void *address)
+{
+    dev->channels[channel - 1].memory = address;
+}
+
+void dma_set_per_addr(dma_dev *dev, dma_channel channel, __io void *address)
+{
+    dev->channels[channel - 1].peripheral = address;
+}
+
+void dma_set_priority(dma_dev *dev, dma_channel channel, dma_priority priority)
+{
+}
+
+void dma_enable(dma_dev *dev, dma_channel channel)
+{
+    dev->channels[channel - 1].enabled = 1;
+}
+
+void dma_disable(dma_dev *dev, dma_channel channel)
+{
+    dev->channels[channel - 1].enabled = 0;
+}
+
+uint16 dma_get_count(dma_dev *dev, dma_channel channel)
+{
+    return dev->channels[channel - 1].count;
+}
+
+void dma_attach_interrupt(dma_dev *dev, dma_channel channel, void (*handler)(void))
+{
+    dev->channels[channel - 1].handler = handler;
+}
+
+void dma_detach_interrupt(dma_dev *dev, dma_channel channel)
+{
+    dev->channels[channel - 1].handler = 0;
+}
+
+dma_irq_cause dma_get_irq_cause(dma_dev *dev, dma_channel channel)
+{
+    return dev->channels[channel - 1].cause;
+}
+
+// timers
+
+static int timerIndex(timer_dev *dev)
+{
+    return dev - timerDevs;
+}
+
+static __io uint32 *ccmr(timer_adv_reg_map *regs, uint8 channel)
+{
+    return channel <= 2 ? &regs->CCMR1 : &regs->CCMR2;
+}
+
+static __io uint32 *ccr(timer_adv_reg_map *regs, uint8 channel)
+{
+    return &regs->CCR1 + (channel - 1);
+}
+
+// OCxREF with the counter at count
+static uint8_t reference(timer_adv_reg_map *regs, uint8 channel, uint32 count)
+{
+    uint32 mode = (*ccmr(regs, channel) >> ((channel - 1) % 2 * 8)) & 0x70;
+    uint32 compare = *ccr(regs, channel);
+
+    switch (mode) {
+        case TIMER_OC_MODE_PWM_1:        return count < compare;
+        case TIMER_OC_MODE_PWM_2:        return count >= compare;
+        case TIMER_OC_MODE_FORCE_ACTIVE: return 1;
+        default:                         return 0;
+    }
+}
+
+static void drivePin(uint8_t pin, uint8_t level, bool *changed)
+{
+    int index = portIndex(PIN_MAP[pin].gpio_device);
+    uint16_t bit = digitalPinToBitMask(pin);
+    uint16_t old = timerOutput[index];
+
+    timerOutput[index] = level ? old | bit : old & ~bit;
+    if (timerOutput[index] != old && (altFunction[index] & bit)) {
+        *changed = true;
+    }
+}
+
+// set the output pins for the counter at count
+static void driveOutputs(int t, uint32 count)
+{
+    timer_adv_reg_map *regs = timerDevs[t].regs.adv;
+    bool moe = t != 0 || (regs->BDTR & TIMER_BDTR_MOE);
+    bool changed = false;
+
+    for (uint8 channel = 1; channel <= 4; channel++) {
+        uint8_t ref = reference(regs, channel, count);
+        uint32 ccer = regs->CCER >> ((channel - 1) * 4);
+        bool main = (ccer & TIMER_CCER_CC1E) && moe;
+        bool complementary = channel <= 3 && t == 0 && (ccer & TIMER_CCER_CC1NE) && moe;
+
+        if (main) {
+            drivePin(timerPins[t][channel - 1], ref ^ ((ccer & TIMER_CCER_CC1P) != 0), &changed);
+        }
+        if (complementary) {
+            // CHxN follows OCxREF on its own, or its inverse alongside CHx
+            uint8_t level = (ccer & TIMER_CCER_CC1E) ? !ref : ref;
+            drivePin(timerPins[t][channel + 3], level ^ ((ccer & TIMER_CCER_CC1NP) != 0), &changed);
+        }
+    }
+
+    if (changed && panel) {
+        panel->sample();
+    }
+}
+
+// a trigger mode slave of TIM1, which has no time of its own
+static bool isSlave(int t)
+{
+    uint32 smcr = timerRegs[t].SMCR;
+    return t != 0 && (smcr & TIMER_SMCR_SMS) == TIMER_SMCR_SMS_TRIGGER &&
+           (smcr & TIMER_SMCR_TS) == TIMER_SMCR_TS_ITR0;
+}
+
+static bool slaveRunning(int t)
+{
+    return isSlave(t) && (timerRegs[t].CR1 & TIMER_CR1_CEN);
+}
+
+// TIM1's enable as TRGO starts its slaves
+static void triggerSlaves()
+{
+    if ((timerRegs[0].CR2 & TIMER_CR2_MMS) != TIMER_CR2_MMS_ENABLE) {
+        return;
+    }
+    for (int t = 1; t < TIMERS; t++) {
+        if (isSlave(t)) {
+            timerRegs[t].CR1 |= TIMER_CR1_CEN;
+        }
+    }
+}
+
+// TIM1 ticks until a running slave reaches a compare or its update
+static uint32 slaveEvent(int t)
+{
+    timer_adv_reg_map *regs = &timerRegs[t];
+    uint32 next = regs->ARR + 1;
+
+    for (uint8 channel = 1; channel <= 4; channel++) {
+        uint32 compare = *ccr(regs, channel);
+        if (compare > regs->CNT && compare < next) {
+            next = compare;
+        }
+    }
+    if (next <= regs->CNT) {
+        return 1;
+    }
+    return (next - regs->CNT) * (regs->PSC + 1) - prescaled[t];
+}
+
+static void advanceSlave(int t, uint32 ticks)
+{
+    timer_adv_reg_map *regs = &timerRegs[t];
+    uint32 total = prescaled[t] + ticks;
+
+    regs->CNT += total / (regs->PSC + 1);
+    prescaled[t] = total % (regs->PSC + 1);
+    if (regs->CNT > regs->ARR) {
+        regs->CNT = 0;
+        prescaled[t] = 0;
+        if (regs->CR1 & TIMER_CR1_OPM) {
+            regs->CR1 &= ~TIMER_CR1_CEN;
+        }
+        regs->SR |= TIMER_SR_UIF;
+    }
+    driveOutputs(t, regs->CNT);
+}
+
+// the panel's time base is TIM1, the scan engine's clock, and its slaves
+// count along with it between their own events
+static void elapse(int t, uint32 ticks)
+{
+    if (t != 0) {
+        return;
+    }
+
+    while (ticks) {
+        uint32 step = ticks;
+        for (int s = 1; s < TIMERS; s++) {
+            if (slaveRunning(s)) {
+                uint32 event = slaveEvent(s);
+                step = event < step ? event : step;
+            }
+        }
+        if (panel) {
+            panel->elapse(step);
+        }
+        for (int s = 1; s < TIMERS; s++) {
+            if (slaveRunning(s)) {
+                advanceSlave(s, step);
+            }
+        }
+        ticks -= step;
+    }
+}
+
+bool native_timer_tick(uint8_t timer)
+{
+    int t = timer - 1;
+    timer_dev *dev = &timerDevs[t];
+    timer_adv_reg_map *regs = dev->regs.adv;
+
+    if (!(regs->CR1 & TIMER_CR1_CEN) || isSlave(t)) {
+        return false;
+    }
+    if (t == 0 && !masterEnabled) {
+        triggerSlaves();
+    }
+
+    // compare events in the order the counter reaches them
+    uint8 order[4] = {1, 2, 3, 4};
+    for (int i = 1; i < 4; i++) {
+        for (int j = i; j > 0 && *ccr(regs, order[j]) < *ccr(regs, order[j - 1]); j--) {
+            uint8 swap = order[j];
+            order[j] = order[j - 1];
+            order[j - 1] = swap;
+        }
+    }
+
+    uint32 periods = (t == 0 ? (regs->RCR & 0xff) : 0) + 1;
+    for (uint32 period = 0; period < periods; period++) {
+        uint32 count = 0;
+        driveOutputs(t, 0);
+        for (int i = 0; i < 4; i++) {
+            uint8 channel = order[i];
+            uint32 compare = *ccr(regs, channel);
+            if (compare > regs->ARR) {
+                continue;
+            }
+            elapse(t, compare - count);
+            count = compare;
+            driveOutputs(t, compare);
+            if (regs->DIER & (TIMER_DIER_CC1DE << (channel - 1))) {
+                dmaRequest(timerDma[t][channel]);
+            }
+        }
+        elapse(t, regs->ARR + 1 - count);
+        if (regs->DIER & TIMER_DIER_UDE) {
+            dmaRequest(timerDma[t][0]);
+        }
+    }
+
+    if (regs->CR1 & TIMER_CR1_OPM) {
+        regs->CR1 &= ~TIMER_CR1_CEN;
+    }
+    if (t == 0) {
+        masterEnabled = (regs->CR1 & TIMER_CR1_CEN) != 0;
+    }
+    regs->CNT = 0;
+    driveOutputs(t, 0);
+
+    regs->SR |= TIMER_SR_UIF;
+    if ((regs->DIER & TIMER_DIER_UIE) && dev->handlers[TIMER_UPDATE_INTERRUPT]) {
+        dev->handlers[TIMER_UPDATE_INTERRUPT]();
+    }
+    return true;
+}
+
+void timer_init(timer_dev *dev)
+{
+}
+
+void timer_pause(timer_dev *dev)
+{
+    dev->regs.adv->CR1 &= ~TIMER_CR1_CEN;
+}
+
+void timer_resume(timer_dev *dev)
+{
+    dev->regs.adv->CR1 |= TIMER_CR1_CEN;
+}
+
+void timer_set_prescaler(timer_dev *dev, uint16 psc)
+{
+    dev->regs.adv->PSC = psc;
+}
+
+void timer_set_reload(timer_dev *dev, uint16 arr)
+{
+    dev->regs.adv->ARR = arr;
+}
+
+void timer_set_compare(timer_dev *dev, uint8 channel, uint16 value)
+{
+    *ccr(dev->regs.adv, channel) = value;
+}
+
+uint16 timer_get_count(timer_dev *dev)
+{
+    return dev->regs.adv->CNT;
+}
+
+void timer_set_count(timer_dev *dev, uint16 value)
+{
+    dev->regs.adv->CNT = value;
+}
+
+void timer_generate_update(timer_dev *dev)
+{
+    dev->regs.adv->CNT = 0;
+    prescaled[timerIndex(dev)] = 0;
+    driveOutputs(timerIndex(dev), 0);
+}
+
+void timer_oc_set_mode(timer_dev *dev, uint8 channel, timer_oc_mode mode, uint8 flags)
+{
+    __io uint32 *reg = ccmr(dev->regs.adv, channel);
+    uint32 shift = (channel - 1) % 2 * 8;
+
+    *reg = (*reg & ~(0xffUL << shift)) | ((uint32)(mode | flags) << shift);
+}
+
+void timer_cc_enable(timer_dev *dev, uint8 channel)
+{
+    dev->regs.adv->CCER |= TIMER_CCER_CC1E << ((channel - 1) * 4);
+}
+
+void timer_cc_set_pol(timer_dev *dev, uint8 channel, uint8 pol)
+{
+    uint32 bit = TIMER_CCER_CC1P << ((channel - 1) * 4);
+    dev->regs.adv->CCER = pol ? dev->regs.adv->CCER | bit : dev->regs.adv->CCER & ~bit;
+}
+
+void timer_dma_enable_req(timer_dev *dev, uint8 channel)
+{
+    dev->regs.adv->DIER |= BIT(8 + channel);
+}
+
+void timer_dma_disable_req(timer_dev *dev, uint8 channel)
+{
+    dev->regs.adv->DIER &= ~BIT(8 + channel);
+}
+
+void timer_attach_interrupt(timer_dev *dev, uint8 interrupt, void (*handler)(void))
+{
+    dev->handlers[interrupt] = handler;
+    dev->regs.adv->DIER |= BIT(interrupt);
+}
+
+void timer_detach_interrupt(timer_dev *dev, uint8 interrupt)
+{
+    dev->regs.adv->DIER &= ~BIT(interrupt);
+    dev->handlers[interrupt] = 0;
+}
+
+HardwareTimer::HardwareTimer(uint8 timerNum)
+{
+    dev = &timerDevs[timerNum - 1];
+}
+
+void HardwareTimer::pause()
+{
+    timer_pause(dev);
+}
+
+void HardwareTimer::resume()
+{
+    timer_resume(dev);
+}
+
+uint32 HardwareTimer::getPrescaleFactor()
+{
+    return dev->regs.adv->PSC + 1;
+}
+
+void HardwareTimer::setPrescaleFactor(uint32 factor)
+{
+    timer_set_prescaler(dev, factor - 1);
+}
+
+uint16 HardwareTimer::getOverflow()
+{
+    return dev->regs.adv->ARR;
+}
+
+void HardwareTimer::setOverflow(uint16 val)
+{
+    timer_set_reload(dev, val);
+}
+
+// as the core does it, the smallest prescaler that fits the 16 bit reload
+uint16 HardwareTimer::setPeriod(uint32 microseconds)
+{
+    uint32 cycles = microseconds * (F_CPU / 1000000);
+    uint16 prescaler = cycles / 65536 + 1;
+    uint16 overflow = (cycles + prescaler / 2) / prescaler;
+
+    setPrescaleFactor(prescaler);
+    setOverflow(overflow);
+    return overflow;
+}
+
+uint16 HardwareTimer::getCompare(int channel)
+{
+    return *ccr(dev->regs.adv, channel);
+}
+
+void HardwareTimer::setCompare(int channel, uint16 compare)
+{
+    timer_set_compare(dev, channel, compare);
+}
+
+uint16 HardwareTimer::getCount()
+{
+    return timer_get_count(dev);
+}
+
+void HardwareTimer::setCount(uint16 val)
+{
+    timer_set_count(dev, val);
+}
+
+void HardwareTimer::attachInterrupt(int channel, voidFuncPtr handler)
+{
+    timer_attach_interrupt(dev, channel, handler);
+}
+
+void HardwareTimer::detachInterrupt(int channel)
+{
+    timer_detach_interrupt(dev, channel);
+}
+
+void HardwareTimer::refresh()
+{
+    timer_generate_update(dev);
+}
+
+HardwareTimer Timer1(1);
+HardwareTimer Timer2(2);
+HardwareTimer Timer3(3);
+HardwareTimer Timer4(4);
+
+// SPI1, always a slave clocked by native_spi_receive()
+
+static spi_reg_map spi1Regs;
+static spi_dev spi1 = {&spi1Regs};
+spi_dev *SPI1 = &spi1;
+
+void native_spi_receive(const uint8_t *data, uint16_t length, uint8_t *reply)
+{
+    for (uint16_t i = 0; i < length; i++) {
+        // whatever was left in DR goes out as this byte comes in
+        if (reply) {
+            reply[i] = spi1Regs.DR;
+        }
+        spi1Regs.DR = data[i];
+        if (spi1Regs.CR2 & SPI_CR2_RXDMAEN) {
+            dmaRequest(SPI1_RX_DMA);
+        }
+        if (spi1Regs.CR2 & SPI_CR2_TXDMAEN) {
+            dmaRequest(SPI1_TX_DMA);
+        }
+    }
+}
+
+void spi_irq_enable(spi_dev *dev, uint32 interrupt_flags)
+{
+    dev->regs->CR2 |= interrupt_flags;
+}
+
+void spi_irq_disable(spi_dev *dev, uint32 interrupt_flags)
+{
+    dev->regs->CR2 &= ~interrupt_flags;
+}
+
+void spi_rx_dma_enable(spi_dev *dev)
+{
+    dev->regs->CR2 |= SPI_CR2_RXDMAEN;
+}
+
+void spi_rx_dma_disable(spi_dev *dev)
+{
+    dev->regs->CR2 &= ~SPI_CR2_RXDMAEN;
+}
+
+void spi_tx_dma_enable(spi_dev *dev)
+{
+    dev->regs->CR2 |= SPI_CR2_TXDMAEN;
+}
+
+void spi_tx_dma_disable(spi_dev *dev)
+{
+    dev->regs->CR2 &= ~SPI_CR2_TXDMAEN;
+}
+
+uint16 spi_rx_reg(spi_dev *dev)
+{
+    return dev->regs->DR;
+}
+
+void spi_tx_reg(spi_dev *dev, uint16 val)
+{
+    dev->regs->DR = val;
+}
+
+SPIClass::SPIClass(uint32 spiPortNumber)
+{
+    device = SPI1;
+}
+
+void SPIClass::setModule(int spi_num)
+{
+}
+
+void SPIClass::setClockDivider(uint32 clockDivider)
+{
+}
+
+void SPIClass::begin()
+{
+}
+
+void SPIClass::beginSlave()
+{
+}
+
+void SPIClass::end()
+{
+}
+
+SPIClass SPI;
+
+// time
+
+static uint64_t nanoseconds()
+{
+    static uint64_t start = 0;
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t ns = (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+    if (!start) {
+        start = ns;
+    }
+    return ns - start;
+}
+
+uint32_t native_cycles()
+{
+    return nanoseconds() * (F_CPU / 1000000) / 1000;
+}
+
+uint32 millis()
+{
+    return nanoseconds() / 1000000;
+}
+
+uint32 micros()
+{
+    return nanoseconds() / 1000;
+}
+
+void delay(uint32 ms)
+{
+    usleep(ms * 1000);
+}
+
+void delayMicroseconds(uint32 us)
+{
+    usleep(us);
+}
+
+// Serial
+
+HostSerial Serial;
+
+void HostSerial::begin(uint32 baud)
+{
+}
+
+size_t HostSerial::write(uint8 c)
+{
+    return fputc(c, stdout) == EOF ? 0 : 1;
+}
+
+size_t HostSerial::print(const char *text)
+{
+    return fputs(text, stdout) == EOF ? 0 : strlen(text);
+}
+
+size_t HostSerial::print(const String &text)
+{
+    return print(text.c_str());
+}
+
+size_t HostSerial::print(char c)
+{
+    return write(c);
+}
+
+size_t HostSerial::print(long value, int base)
+{
+    return printf(base == HEX ? "%lx" : "%ld", value);
+}
+
+size_t HostSerial::print(unsigned long value, int base)
+{
+    return printf(base == HEX ? "%lx" : "%lu", value);
+}
+
+size_t HostSerial::print(int value, int base)
+{
+    return print((long) value, base);
+}
+
+size_t HostSerial::print(unsigned int value, int base)
+{
+    return print((unsigned long) value, base);
+}
+
+size_t HostSerial::println()
+{
+    return print("\r\n");
+}
+
+// one pass of the firmware: loop(), then TIM1 until the panel has shown a
+// whole frame and one update event for each other running timer
+void native_pass()
+{
+    loop();
+
+    uint32_t frames = panel ? panel->frames() : 0;
+    for (int tick = 0; tick < MAX_TICKS && native_timer_tick(1); tick++) {
+        if (panel && panel->frames() != frames) {
+            break;
+        }
+    }
+    for (uint8_t timer = 2; timer <= TIMERS; timer++) {
+        native_timer_tick(timer);
+    }
+}
+
+#ifndef NATIVE_NO_MAIN
+// bytes on stdin are clocked into SPI1 FEED_BYTES at a time between passes,
+// then the panel image and the cost of a frame are printed
+int main(int argc, char **argv)
+{
+    std::vector<uint8_t> input;
+
+    if (!isatty(STDIN_FILENO)) {
+        uint8_t chunk[256];
+        size_t length;
+        while ((length = fread(chunk, 1, sizeof(chunk), stdin)) > 0) {
+            input.insert(input.end(), chunk, chunk + length);
+        }
+    }
+
+    setup();
+    native_pass();                  // count from a frame boundary
+    if (panel) {
+        panel->resetCounters();
+    }
+
+    for (size_t offset = 0; offset < input.size(); offset += FEED_BYTES) {
+        size_t length = input.size() - offset < FEED_BYTES ? input.size() - offset : FEED_BYTES;
+        native_spi_receive(&input[offset], length);
+        native_pass();
+    }
+    for (int i = 0; i < SETTLE_PASSES; i++) {
+        native_pass();
+    }
+
+    if (panel) {
+        uint32_t frames = panel->frames() ? panel->frames() : 1;
+        panel->print(stdout);
+        printf("frames %u, per frame: clocks %u, latches %u, port writes %u\n",
+               panel->frames(), panel->clocks() / frames, panel->latches() / frames,
+               panel->writes() / frames);
+        if (panel->ticks()) {
+            printf("lit %u.%u%% of TIM1 ticks\n", panel->lit() * 100 / panel->ticks(),
+                   panel->lit() * 1000 / panel->ticks() % 10);
+        }
+    }
+    return 0;
+}
+#endif
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2017 David McKelvie.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __NATIVE_HAL_H__
+#define __NATIVE_HAL_H__
+
+#include <stdint.h>
+
+/*
+ * Host side of the HAL shim. GPIO, TIM1, DMA1 and SPI1 are modelled in
+ * memory closely enough for LEDMatrix, ScanEngine and main.cpp to run
+ * unchanged, and every port store is passed on to the attached Panel.
+ */
+
+class Panel;
+
+// store to a GPIO register, reg may be a simulated port or a hardware address
+#define PORT_WRITE(reg, value)  native_port_write((reg), (value))
+
+void native_port_write(volatile uint32_t *reg, uint32_t value);
+
+/**
+ * level currently on a pin, from its ODR bit or the timer output driving it
+ */
+uint8_t native_pin(uint8_t pin);
+
+/**
+ * the panel told about every port store, a Panel attaches itself
+ */
+void native_attach(Panel *panel);
+
+/**
+ * 72MHz ticks of the host's monotonic clock, stands in for the DWT counter
+ */
+uint32_t native_cycles();
+
+/**
+ * clock bytes into SPI1 as the bus master would, RX DMA moves them if enabled
+ * @param reply     if not 0, set to the bytes shifted out on MISO meanwhile
+ */
+void native_spi_receive(const uint8_t *data, uint16_t length, uint8_t *reply = 0);
+
+/**
+ * run a running timer until its next update event, performing the DMA
+ * requests and output compare edges on the way.
+ * @return false if the timer is stopped
+ */
+bool native_timer_tick(uint8_t timer);
+
+/**
+ * loop() once, then TIM1 for a frame and the other timers for an update.
+ * Tools built with -D NATIVE_NO_MAIN drive the firmware with this.
+ */
+void native_pass();
+
+#endif
@@ -0,0 +1,186 @@
+/*
+ * Copyright (C) 2017 David McKelvie.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include "NativeHal.h"
+#include "Panel.h"
+
+Panel::Panel(uint8_t a, uint8_t b, uint8_t c, uint8_t d, uint8_t oe, uint8_t lat, uint8_t clk,
+             uint8_t r1, uint8_t r2, uint8_t g1, uint8_t g2, uint8_t b1, uint8_t b2,
+             uint16_t columns, uint8_t rows)
+    : oe(oe), lat(lat), clk(clk), columns(columns), rows(rows)
+{
+    addressPins[0] = a;
+    addressPins[1] = b;
+    addressPins[2] = c;
+    addressPins[3] = d;
+
+    // upper half colour lines then lower, the bit order of shift[] and latch[]
+    dataPins[0] = r1;
+    dataPins[1] = g1;
+    dataPins[2] = b1;
+    dataPins[3] = r2;
+    dataPins[4] = g2;
+    dataPins[5] = b2;
+
+    if (this->rows > PANEL_MAX_ROWS) {
+        this->rows = PANEL_MAX_ROWS;
+    }
+    activeLow = 0;
+
+    shift = new uint8_t[columns];
+    latch = new uint8_t[columns];
+    image = new uint8_t[columns * this->rows * 2];
+    memset(shift, 0, columns);
+    memset(latch, 0, columns);
+    memset(image, 0, columns * this->rows * 2);
+
+    lastClk = lastLat = 0;
+    lastOe = 1;
+    lastRow = 0;
+    lastLatched = 0;
+    latchedLit = 0;
+    resetCounters();
+
+    native_attach(this);
+}
+
+Panel::~Panel()
+{
+    native_attach(0);
+    delete[] shift;
+    delete[] latch;
+    delete[] image;
+}
+
+void Panel::setActiveLow(bool activeLow)
+{
+    this->activeLow = activeLow;
+}
+
+void Panel::resetCounters()
+{
+    clockCount = 0;
+    latchCount = 0;
+    writeCount = 0;
+    frameCount = 0;
+    tickCount = 0;
+    litCount = 0;
+}
+
+void Panel::elapse(uint32_t ticks)
+{
+    tickCount += ticks;
+    if (!level(oe)) {
+        litCount += ticks;
+    }
+}
+
+uint8_t Panel::level(uint8_t pin)
+{
+    return pin == PANEL_NO_PIN ? 0 : native_pin(pin);
+}
+
+void Panel::store()
+{
+    writeCount++;
+    sample();
+}
+
+void Panel::sample()
+{
+    uint8_t clkLevel = level(clk);
+    uint8_t latLevel = level(lat);
+    uint8_t oeLevel = level(oe);
+    uint8_t row = 0;
+    for (uint8_t i = 0; i < 4; i++) {
+        if (addressPins[i] != PANEL_NO_PIN && level(addressPins[i])) {
+            row |= 1 << i;
+        }
+    }
+    row %= rows;
+
+    if (clkLevel && !lastClk) {
+        uint8_t in = 0;
+        for (uint8_t line = 0; line < LINES; line++) {
+            if (dataPins[line] != PANEL_NO_PIN && (level(dataPins[line]) ^ activeLow)) {
+                in |= 1 << line;
+            }
+        }
+        memmove(shift, shift + 1, columns - 1);
+        shift[columns - 1] = in;
+        clockCount++;
+    }
+
+    bool changed = row != lastRow || (!oeLevel && lastOe);
+    if (latLevel && !lastLat) {
+        if (!latchedLit) {
+            // dark from its latch until this one
+            memset(image + lastLatched * columns, 0, columns);
+            memset(image + (lastLatched + rows) * columns, 0, columns);
+        }
+        latchedLit = 0;
+        memcpy(latch, shift, columns);
+        latchCount++;
+        if (row == 0 && lastLatched != 0) {
+            frameCount++;
+        }
+        lastLatched = row;
+        changed = true;
+    }
+
+    lastClk = clkLevel;
+    lastLat = latLevel;
+    lastOe = oeLevel;
+    lastRow = row;
+
+    if (changed && !oeLevel) {
+        show();
+    }
+}
+
+// the latched row is lit, copy it into the image
+void Panel::show()
+{
+    uint8_t *upper = image + lastRow * columns;
+    uint8_t *lower = image + (lastRow + rows) * columns;
+
+    for (uint16_t x = 0; x < columns; x++) {
+        upper[x] = latch[x] & 0x07;
+        lower[x] = latch[x] >> 3;
+    }
+    latchedLit = 1;
+}
+
+uint8_t Panel::pixel(uint16_t x, uint16_t y)
+{
+    if (x >= columns || y >= rows * 2) {
+        return 0;
+    }
+    return image[y * columns + x];
+}
+
+void Panel::print(FILE *out)
+{
+    static const char colours[] = ".RGYBMCW";
+
+    for (uint16_t y = 0; y < rows * 2; y++) {
+        for (uint16_t x = 0; x < columns; x++) {
+            fputc(colours[pixel(x, y)], out);
+        }
+        fputc('\n', out);
+    }
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2017 David McKelvie.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __PANEL_H__
+#define __PANEL_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define PANEL_NO_PIN    0xff
+#define PANEL_MAX_ROWS  16
+
+/**
+ * A HUB08 or HUB75 panel chain driven from simulated pins.
+ *
+ * Each colour line feeds a shift register columns long. A rising clock
+ * edge shifts every line in, a rising latch edge copies the shift
+ * registers to the output latches, and while OE is low the latches light
+ * scan row a-d of the upper half and the same row of the lower half.
+ * The image is whatever each row last showed, so with more than one bit
+ * plane it holds the last plane latched rather than the weighted colour.
+ * A row that is latched but not lit before the next latch shows nothing.
+ *
+ * The chain is unfolded, pixel x is the x'th bit shifted in for a row. A
+ * 192 x 32 sign with 16 scan rows is a 192 column, 16 row chain.
+ */
+class Panel {
+public:
+    /**
+     * pins as wired to the sign, PANEL_NO_PIN for colour lines a HUB08
+     * panel does not have
+     */
+    Panel(uint8_t a, uint8_t b, uint8_t c, uint8_t d, uint8_t oe, uint8_t lat, uint8_t clk,
+          uint8_t r1, uint8_t r2, uint8_t g1, uint8_t g2, uint8_t b1, uint8_t b2,
+          uint16_t columns, uint8_t rows);
+    ~Panel();
+
+    /**
+     * data lines are active low, as on HUB08 panels driven with reverse()
+     */
+    void setActiveLow(bool activeLow);
+
+    /**
+     * a port has been written, counted then sampled
+     */
+    void store();
+
+    /**
+     * look at the pins again, called by the HAL whenever one may have changed
+     */
+    void sample();
+
+    /**
+     * TIM1 has counted ticks with the pins as they are, for lit()
+     */
+    void elapse(uint32_t ticks);
+
+    /**
+     * colour last shown at x, y: bit 0 red, bit 1 green, bit 2 blue
+     */
+    uint8_t pixel(uint16_t x, uint16_t y);
+
+    uint16_t width() { return columns; }
+    uint16_t height() { return rows * 2; }
+
+    /**
+     * the image as text, '.' for off and a letter per colour
+     */
+    void print(FILE *out);
+
+    // activity since the last resetCounters()
+    uint32_t clocks() { return clockCount; }
+    uint32_t latches() { return latchCount; }
+    uint32_t writes() { return writeCount; }
+    uint32_t frames() { return frameCount; }
+    uint32_t ticks() { return tickCount; }
+    uint32_t lit() { return litCount; }       // ticks with OE low
+    void resetCounters();
+
+private:
+    enum { LINES = 6 };                 // r1, g1, b1, r2, g2, b2
+
+    uint8_t level(uint8_t pin);
+    void show();
+
+    uint8_t addressPins[4];
+    uint8_t oe, lat, clk;
+    uint8_t dataPins[LINES];
+    uint16_t columns;
+    uint8_t rows;
+    uint8_t activeLow;
+
+    uint8_t *shift;                     // columns entries per line, bit per line
+    uint8_t *latch;
+    uint8_t *image;                     // columns x rows * 2, colour bits
+
+    uint8_t lastClk, lastLat, lastOe, lastRow;
+    uint8_t lastLatched;
+    uint8_t latchedLit;                 // the row last latched has been shown
+    uint32_t clockCount, latchCount, writeCount, frameCount;
+    uint32_t tickCount, litCount;
+};
+
+#endif
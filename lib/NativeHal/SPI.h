@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2017 David McKelvie.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SPI_H__
+#define __SPI_H__
+
+#include <Arduino.h>
+
+#define SPI_CR2_RXDMAEN     BIT(0)
+#define SPI_CR2_TXDMAEN     BIT(1)
+#define SPI_CR2_RXNEIE      BIT(6)
+#define SPI_CR2_TXEIE       BIT(7)
+
+#define SPI_RXNE_INTERRUPT  SPI_CR2_RXNEIE
+#define SPI_TXE_INTERRUPT   SPI_CR2_TXEIE
+
+typedef struct spi_reg_map {
+    __io uint32 CR1;
+    __io uint32 CR2;
+    __io uint32 SR;
+    __io uint32 DR;
+    __io uint32 CRCPR;
+    __io uint32 RXCRCR;
+    __io uint32 TXCRCR;
+    __io uint32 I2SCFGR;
+    __io uint32 I2SPR;
+} spi_reg_map;
+
+typedef struct spi_dev {
+    spi_reg_map *regs;
+} spi_dev;
+
+extern spi_dev *SPI1;
+
+enum {
+    SPI_CLOCK_DIV2,
+    SPI_CLOCK_DIV4,
+    SPI_CLOCK_DIV8,
+    SPI_CLOCK_DIV16,
+    SPI_CLOCK_DIV32,
+    SPI_CLOCK_DIV64,
+    SPI_CLOCK_DIV128,
+    SPI_CLOCK_DIV256,
+};
+
+void spi_irq_enable(spi_dev *dev, uint32 interrupt_flags);
+void spi_irq_disable(spi_dev *dev, uint32 interrupt_flags);
+void spi_rx_dma_enable(spi_dev *dev);
+void spi_rx_dma_disable(spi_dev *dev);
+void spi_tx_dma_enable(spi_dev *dev);
+void spi_tx_dma_disable(spi_dev *dev);
+uint16 spi_rx_reg(spi_dev *dev);
+void spi_tx_reg(spi_dev *dev, uint16 val);
+
+class SPIClass {
+public:
+    SPIClass(uint32 spiPortNumber = 1);
+
+    void setModule(int spi_num);
+    void setClockDivider(uint32 clockDivider);
+    void begin();
+    void beginSlave();
+    void end();
+    spi_dev *dev() { return device; }
+
+private:
+    spi_dev *device;
+};
+
+extern SPIClass SPI;
+
+#endif
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2017 David McKelvie.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __LIBMAPLE_DMA_H__
+#define __LIBMAPLE_DMA_H__
+
+#include <Arduino.h>
+
+struct dma_dev;
+extern dma_dev *const DMA1;
+
+typedef enum dma_channel {
+    DMA_CH1 = 1,
+    DMA_CH2,
+    DMA_CH3,
+    DMA_CH4,
+    DMA_CH5,
+    DMA_CH6,
+    DMA_CH7,
+} dma_channel;
+
+typedef enum dma_xfer_size {
+    DMA_SIZE_8BITS,
+    DMA_SIZE_16BITS,
+    DMA_SIZE_32BITS,
+} dma_xfer_size;
+
+typedef enum dma_priority {
+    DMA_PRIORITY_LOW,
+    DMA_PRIORITY_MEDIUM,
+    DMA_PRIORITY_HIGH,
+    DMA_PRIORITY_VERY_HIGH,
+} dma_priority;
+
+typedef enum dma_irq_cause {
+    DMA_TRANSFER_COMPLETE,
+    DMA_TRANSFER_HALF_COMPLETE,
+    DMA_TRANSFER_ERROR,
+} dma_irq_cause;
+
+// dma_setup_transfer() mode flags, as the CCR bits
+#define DMA_TRNS_CMPLT      BIT(1)
+#define DMA_HALF_TRNS       BIT(2)
+#define DMA_TRNS_ERR        BIT(3)
+#define DMA_FROM_MEM        BIT(4)
+#define DMA_CIRC_MODE       BIT(5)
+#define DMA_PINC_MODE       BIT(6)
+#define DMA_MINC_MODE       BIT(7)
+#define DMA_MEM_2_MEM       BIT(14)
+
+void dma_init(dma_dev *dev);
+void dma_setup_transfer(dma_dev *dev, dma_channel channel,
+                        __io void *peripheral_address, dma_xfer_size peripheral_size,
+                        __io void *memory_address, dma_xfer_size memory_size,
+                        uint32 mode);
+void dma_set_num_transfers(dma_dev *dev, dma_channel channel, uint16 num_transfers);
+void dma_set_mem_addr(dma_dev *dev, dma_channel channel, __io void *address);
+void dma_set_per_addr(dma_dev *dev, dma_channel channel, __io void *address);
+void dma_set_priority(dma_dev *dev, dma_channel channel, dma_priority priority);
+void dma_enable(dma_dev *dev, dma_channel channel);
+void dma_disable(dma_dev *dev, dma_channel channel);
+uint16 dma_get_count(dma_dev *dev, dma_channel channel);
+void dma_attach_interrupt(dma_dev *dev, dma_channel channel, void (*handler)(void));
+void dma_detach_interrupt(dma_dev *dev, dma_channel channel);
+dma_irq_cause dma_get_irq_cause(dma_dev *dev, dma_channel channel);
+
+#endif
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2017 David McKelvie.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __LIBMAPLE_TIMER_H__
+#define __LIBMAPLE_TIMER_H__
+
+#include <Arduino.h>
+
+typedef struct timer_adv_reg_map {
+    __io uint32 CR1;
+    __io uint32 CR2;
+    __io uint32 SMCR;
+    __io uint32 DIER;
+    __io uint32 SR;
+    __io uint32 EGR;
+    __io uint32 CCMR1;
+    __io uint32 CCMR2;
+    __io uint32 CCER;
+    __io uint32 CNT;
+    __io uint32 PSC;
+    __io uint32 ARR;
+    __io uint32 RCR;
+    __io uint32 CCR1;
+    __io uint32 CCR2;
+    __io uint32 CCR3;
+    __io uint32 CCR4;
+    __io uint32 BDTR;
+    __io uint32 DCR;
+    __io uint32 DMAR;
+} timer_adv_reg_map;
+
+// general purpose timers share the layout, without RCR and BDTR
+typedef timer_adv_reg_map timer_gen_reg_map;
+
+typedef enum timer_interrupt_id {
+    TIMER_UPDATE_INTERRUPT,
+    TIMER_CC1_INTERRUPT,
+    TIMER_CC2_INTERRUPT,
+    TIMER_CC3_INTERRUPT,
+    TIMER_CC4_INTERRUPT,
+    TIMER_COM_INTERRUPT,
+    TIMER_TRG_INTERRUPT,
+    TIMER_BREAK_INTERRUPT,
+} timer_interrupt_id;
+
+typedef struct timer_dev {
+    union {
+        timer_adv_reg_map *adv;
+        timer_gen_reg_map *gen;
+    } regs;
+    void (*handlers[8])(void);
+} timer_dev;
+
+extern timer_dev *const TIMER1;
+extern timer_dev *const TIMER2;
+extern timer_dev *const TIMER3;
+extern timer_dev *const TIMER4;
+
+#define TIMER_CR1_CEN       BIT(0)
+#define TIMER_CR1_UDIS      BIT(1)
+#define TIMER_CR1_OPM       BIT(3)
+#define TIMER_CR1_ARPE      BIT(7)
+
+#define TIMER_DIER_UIE      BIT(0)
+#define TIMER_DIER_UDE      BIT(8)
+#define TIMER_DIER_CC1DE    BIT(9)
+
+#define TIMER_SR_UIF        BIT(0)
+#define TIMER_EGR_UG        BIT(0)
+
+#define TIMER_CCER_CC1E     BIT(0)
+#define TIMER_CCER_CC1P     BIT(1)
+#define TIMER_CCER_CC1NE    BIT(2)
+#define TIMER_CCER_CC1NP    BIT(3)
+#define TIMER_CCER_CC2NE    BIT(6)
+#define TIMER_CCER_CC3NE    BIT(10)
+
+#define TIMER_BDTR_OSSI     BIT(10)
+#define TIMER_BDTR_MOE      BIT(15)
+
+#define TIMER_CR2_OIS1N     BIT(9)
+#define TIMER_CR2_MMS       (0x7 << 4)
+#define TIMER_CR2_MMS_ENABLE (0x1 << 4)
+
+#define TIMER_SMCR_SMS      0x7
+#define TIMER_SMCR_SMS_TRIGGER 0x6
+#define TIMER_SMCR_TS       (0x7 << 4)
+#define TIMER_SMCR_TS_ITR0  (0x0 << 4)
+
+typedef enum timer_oc_mode {
+    TIMER_OC_MODE_FROZEN = 0 << 4,
+    TIMER_OC_MODE_ACTIVE_ON_MATCH = 1 << 4,
+    TIMER_OC_MODE_INACTIVE_ON_MATCH = 2 << 4,
+    TIMER_OC_MODE_TOGGLE = 3 << 4,
+    TIMER_OC_MODE_FORCE_INACTIVE = 4 << 4,
+    TIMER_OC_MODE_FORCE_ACTIVE = 5 << 4,
+    TIMER_OC_MODE_PWM_1 = 6 << 4,
+    TIMER_OC_MODE_PWM_2 = 7 << 4,
+} timer_oc_mode;
+
+#define TIMER_OC_FE         BIT(2)
+#define TIMER_OC_PE         BIT(3)
+
+void timer_init(timer_dev *dev);
+void timer_pause(timer_dev *dev);
+void timer_resume(timer_dev *dev);
+void timer_set_prescaler(timer_dev *dev, uint16 psc);
+void timer_set_reload(timer_dev *dev, uint16 arr);
+void timer_set_compare(timer_dev *dev, uint8 channel, uint16 value);
+uint16 timer_get_count(timer_dev *dev);
+void timer_set_count(timer_dev *dev, uint16 value);
+void timer_generate_update(timer_dev *dev);
+void timer_oc_set_mode(timer_dev *dev, uint8 channel, timer_oc_mode mode, uint8 flags);
+void timer_cc_enable(timer_dev *dev, uint8 channel);
+void timer_cc_set_pol(timer_dev *dev, uint8 channel, uint8 pol);
+void timer_dma_enable_req(timer_dev *dev, uint8 channel);
+void timer_dma_disable_req(timer_dev *dev, uint8 channel);
+void timer_attach_interrupt(timer_dev *dev, uint8 interrupt, void (*handler)(void));
+void timer_detach_interrupt(timer_dev *dev, uint8 interrupt);
+
+#endif
@@ -17,18 +17,190 @@
 #ifndef __BUFFER_H__
 #define __BUFFER_H__
 #include <stdint.h>
+#include <string.h>
 
+//////////////////////////////////////////////////////////
+///
+///\brief   single producer, single consumer ring buffer
+///
+/// head and tail run freely and are masked on access, so Size must be a
+/// power of two and the whole buffer is usable. tail - head has to tell a
+/// lap from a full buffer, which limits Size to half the range of Index.
+/// The producer only writes tail and the consumer only writes head, each
+/// publishes with a release store and reads the other with an acquire
+/// load, so an interrupt can produce while loop() consumes.
+///
+/// Data can also be written into storage() by DMA and published with
+/// produce(). If that laps unread data the consumer discards everything.
+///
+//////////////////////////////////////////////////////////
+template <typename T, uint32_t Size, typename Index = uint16_t>
 class CircularBuffer {
+  static_assert((Size & (Size - 1)) == 0, "Size must be a power of two");
+  static_assert(Size <= ((Index) ~(Index) 0 >> 1) + 1, "Size too big for Index");
+
 public:
-  CircularBuffer();
-  void begin(uint8_t *buffer, uint8_t size);
-  bool put(uint8_t data);
-  bool get(uint8_t *ptrChar);
+  CircularBuffer()
+  {
+    head = 0;
+    tail = 0;
+    overflowCount = 0;
+  }
+
+  T *storage() { return buffer; }
+  static Index capacity() { return Size; }
+
+  // consumer side
+
+  Index available()
+  {
+    Index produced = load(tail);
+
+    // the producer lapped the reader, nothing unread can be trusted
+    if ((Index) (produced - head) > Size) {
+      store(head, produced);
+    }
+    return (Index) (produced - head);
+  }
+
+  bool get(T *item)
+  {
+    return read(item, 1) == 1;
+  }
+
+  //////////////////////////////////////////////////////////
+  ///
+  ///\brief   copy data out without consuming it
+  ///
+  ///\param   dst    destination
+  ///\param   count  number of items wanted
+  ///\param   offset items to skip from the oldest
+  ///\return  number of items copied
+  ///
+  //////////////////////////////////////////////////////////
+  Index peek(T *dst, Index count, Index offset = 0)
+  {
+    Index ready = available();
+    if (offset >= ready) return 0;
+    if (count > ready - offset) count = ready - offset;
+
+    Index start = (head + offset) & (Size - 1);
+    Index first = count < Size - start ? count : Size - start;
+    memcpy(dst, buffer + start, first * sizeof(T));
+    memcpy(dst + first, buffer, (count - first) * sizeof(T));
+    return count;
+  }
+
+  Index read(T *dst, Index count)
+  {
+    count = peek(dst, count);
+    skip(count);
+    return count;
+  }
+
+  //////////////////////////////////////////////////////////
+  ///
+  ///\brief   the oldest unread items that are contiguous in storage
+  ///
+  ///\param   span set to the oldest item
+  ///\return  number of items at span, consume them with skip()
+  ///
+  //////////////////////////////////////////////////////////
+  Index contiguous(const T **span)
+  {
+    Index ready = available();
+    Index start = head & (Size - 1);
+    *span = buffer + start;
+    return ready < Size - start ? ready : Size - start;
+  }
+
+  void skip(Index count)
+  {
+    store(head, (Index) (head + count));
+  }
+
+  // items taken so far, including any discarded after a lap, wraps with Index
+  Index consumed()
+  {
+    return load(head);
+  }
+
+  // producer side
+
+  Index space()
+  {
+    return Size - (Index) (tail - load(head));
+  }
+
+  // items written and not yet taken, the whole buffer once lapped. Unlike
+  // available() it writes nothing, so the producer can watch the level
+  Index pending() const
+  {
+    Index level = (Index) (tail - load(head));
+    return level < Size ? level : Size;
+  }
+
+  bool put(T item)
+  {
+    return write(&item, 1) == 1;
+  }
+
+  //////////////////////////////////////////////////////////
+  ///
+  ///\brief   copy data in
+  ///
+  ///\param   src    data to add
+  ///\param   count  number of items
+  ///\return  number of items added, fewer than count counts an overflow
+  ///
+  //////////////////////////////////////////////////////////
+  Index write(const T *src, Index count)
+  {
+    Index room = space();
+    if (count > room) {
+      count = room;
+      overflowCount++;
+    }
+
+    Index start = tail & (Size - 1);
+    Index first = count < Size - start ? count : Size - start;
+    memcpy(buffer + start, src, first * sizeof(T));
+    memcpy(buffer, src + first, (count - first) * sizeof(T));
+    store(tail, (Index) (tail + count));
+    return count;
+  }
+
+  //////////////////////////////////////////////////////////
+  ///
+  ///\brief   publish items already written to storage() at tail, e.g. by DMA
+  ///
+  ///\param   count number of items written
+  ///\return  false if they overwrote unread data
+  ///
+  //////////////////////////////////////////////////////////
+  bool produce(Index count)
+  {
+    bool lapped = count > space();
+    if (lapped) {
+      store(overflowCount, overflowCount + 1);
+    }
+    store(tail, (Index) (tail + count));
+    return !lapped;
+  }
+
+  uint32_t overflows()
+  {
+    return load(overflowCount);
+  }
+
 private:
-  uint8_t head;
-  uint8_t tail;
-  uint8_t size;
-  uint8_t *buffer;
+  template <typename V> static V load(V &v) { return __atomic_load_n(&v, __ATOMIC_ACQUIRE); }
+  template <typename V> static void store(V &v, V value) { __atomic_store_n(&v, value, __ATOMIC_RELEASE); }
+
+  T buffer[Size];
+  Index head;               // written by the consumer
+  Index tail;               // written by the producer
+  uint32_t overflowCount;   // written by the producer
 };
 
 #endif /* __BUFFER_H__ */
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2017 David McKelvie.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include "delta.h"
+
+bool delta_check(const uint8_t *runs, uint16_t length, uint32_t count)
+{
+  const uint8_t *end = runs + length;
+  uint32_t total = 0;
+
+  while (runs < end) {
+    uint8_t op = *runs++;
+    total += (op & 0x7F) + 1;
+    runs += (op & 0x80) ? 1 : (op & 0x7F) + 1;
+  }
+  return runs == end && total == count;
+}
+
+void delta_decode(uint8_t *dest, uint16_t stride, uint16_t width, uint8_t flags,
+                  const uint8_t *runs, uint16_t length)
+{
+  const uint8_t *end = runs + length;
+  uint8_t *row = dest;
+  uint16_t column = 0;
+  bool xor_in = flags & DELTA_XOR;
+
+  while (runs < end) {
+    uint8_t op = *runs++;
+    uint8_t count = (op & 0x7F) + 1;
+
+    if (op & 0x80) {
+      uint8_t value = *runs++;
+      if (xor_in && !value) {
+        // unchanged, step over
+        column += count;
+        while (column >= width) {
+          column -= width;
+          row += stride;
+        }
+        continue;
+      }
+      while (count--) {
+        row[column] = xor_in ? row[column] ^ value : value;
+        if (++column == width) {
+          column = 0;
+          row += stride;
+        }
+      }
+    } else {
+      while (count--) {
+        uint8_t value = *runs++;
+        row[column] = xor_in ? row[column] ^ value : value;
+        if (++column == width) {
+          column = 0;
+          row += stride;
+        }
+      }
+    }
+  }
+}
+
+static inline uint8_t deltaByte(const uint8_t *previous, const uint8_t *next, uint32_t i)
+{
+  return previous ? previous[i] ^ next[i] : next[i];
+}
+
+uint32_t delta_encode(const uint8_t *previous, const uint8_t *next, uint32_t count,
+                      uint8_t *out, uint32_t capacity)
+{
+  uint32_t i = 0;
+  uint32_t length = 0;
+
+  while (i < count) {
+    // three or more of a byte are cheaper as a repeat than as literals
+    uint8_t value = deltaByte(previous, next, i);
+    uint32_t repeat = 1;
+    while (i + repeat < count && repeat < DELTA_RUN && deltaByte(previous, next, i + repeat) == value) {
+      repeat++;
+    }
+    if (repeat >= 3) {
+      if (length + 2 > capacity) return 0;
+      out[length++] = 0x80 | (repeat - 1);
+      out[length++] = value;
+      i += repeat;
+      continue;
+    }
+
+    // literals up to the next such repeat
+    uint32_t literal = 0;
+    while (i + literal < count && literal < DELTA_RUN) {
+      uint32_t j = i + literal;
+      uint8_t b = deltaByte(previous, next, j);
+      if (j + 3 <= count &&
+          deltaByte(previous, next, j + 1) == b && deltaByte(previous, next, j + 2) == b) {
+        break;
+      }
+      literal++;
+    }
+    if (length + 1 + literal > capacity) return 0;
+    out[length++] = literal - 1;
+    for (uint32_t k = 0; k < literal; k++) {
+      out[length++] = deltaByte(previous, next, i + k);
+    }
+    i += literal;
+  }
+  return length;
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2017 David McKelvie.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __DELTA_H__
+#define __DELTA_H__
+#include <stdint.h>
+
+// Run length coded region updates, shared by the firmware and host encoders.
+// A region's bytes, row by row, are coded as runs:
+//
+//   0x00 - 0x7F | n + 1 bytes          literal
+//   0x80 - 0xFF | byte                 (n & 0x7F) + 1 copies of byte
+//
+// With DELTA_XOR each decoded byte is XORed into the region, so bytes that
+// have not changed are runs of 0x00 and cost nothing to apply. Without it
+// decoded bytes replace the region's. XOR deltas are against what the
+// display already holds, the host has to track that.
+//
+// A CMD_DELTA payload is flags, then x, y, width and height of the region
+// (16 bit each, x and width multiples of 8), then the runs.
+#define DELTA_XOR       0x01
+#define DELTA_RUN       128     // longest run
+#define DELTA_HEADER    9       // payload ahead of the runs
+
+//////////////////////////////////////////////////////////
+///
+///\brief   check runs decode to exactly count bytes
+///
+///\param   runs   coded runs
+///\param   length bytes of runs
+///\param   count  bytes in the region
+///\return  true if they do
+///
+//////////////////////////////////////////////////////////
+bool delta_check(const uint8_t *runs, uint16_t length, uint32_t count);
+
+//////////////////////////////////////////////////////////
+///
+///\brief   apply checked runs to a region in place, a row at a time
+///
+///\param   dest   first byte of the region
+///\param   stride bytes from one row of the buffer to the next
+///\param   width  bytes in a row of the region
+///\param   flags  DELTA_XOR, or 0 to replace
+///\param   runs   coded runs, see delta_check()
+///\param   length bytes of runs
+///
+//////////////////////////////////////////////////////////
+void delta_decode(uint8_t *dest, uint16_t stride, uint16_t width, uint8_t flags,
+                  const uint8_t *runs, uint16_t length);
+
+//////////////////////////////////////////////////////////
+///
+///\brief   code a region for delta_decode(), for hosts
+///
+///\param   previous what the region holds now for DELTA_XOR, 0 to replace
+///\param   next     what it should hold
+///\param   count    bytes in the region, row by row
+///\param   out      coded runs
+///\param   capacity bytes available at out
+///\return  bytes of runs, 0 if they do not fit
+///
+//////////////////////////////////////////////////////////
+uint32_t delta_encode(const uint8_t *previous, const uint8_t *next, uint32_t count,
+                      uint8_t *out, uint32_t capacity);
+
+#endif /* __DELTA_H__ */
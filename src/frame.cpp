@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2017 David McKelvie.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include "frame.h"
+
+// CRC-16/CCITT (polynomial 0x1021) a nibble at a time
+static const uint16_t crcTable[16] = {
+  0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+  0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+};
+
+//////////////////////////////////////////////////////////
+///
+///\brief   CRC-16/CCITT-FALSE
+///
+///\param   data   bytes to check
+///\param   length number of bytes
+///\param   crc    FRAME_CRC_INIT, or the result of a previous call to continue
+///\return  crc
+///
+//////////////////////////////////////////////////////////
+uint16_t crc16(const uint8_t *data, uint16_t length, uint16_t crc)
+{
+  while (length--) {
+    uint8_t byte = *data++;
+    crc = (crc << 4) ^ crcTable[(crc >> 12) ^ (byte >> 4)];
+    crc = (crc << 4) ^ crcTable[(crc >> 12) ^ (byte & 0x0F)];
+  }
+  return crc;
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2017 David McKelvie.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __FRAME_H__
+#define __FRAME_H__
+#include <stdint.h>
+
+// Protocol v2 frame, multi byte fields are little endian:
+//
+//   SOH | length (2) | command | payload (length bytes) | crc (2)
+//
+// crc is CRC-16/CCITT-FALSE over length, command and payload. Payloads are
+// binary, a v1 STX ... ETX command can still be sent between frames. After
+// a CRC error, an over long length or a frame that stops arriving, the sign
+// ignores everything up to the next SOH, v1 commands included.
+#define SOH             1
+#define FRAME_HEADER    3 // SOH and length
+#define FRAME_OVERHEAD  (FRAME_HEADER + 1 + 2)
+#define FRAME_CRC_INIT  0xFFFF
+
+typedef enum {
+  FRAME_NONE,         // nothing received yet
+  FRAME_ACK,          // valid and applied
+  FRAME_NAK,          // valid but the command or its payload was not
+  FRAME_CRC_ERROR,
+  FRAME_TOO_LONG,
+  FRAME_TIMEOUT,      // the rest of the frame never arrived
+} frame_result_t;
+
+// Every byte clocked in on MOSI shifts a status byte out on MISO, as it was
+// when loop() last looked at the ring:
+//
+//   bit 7      busy, input is waiting or a command is part way through
+//   bits 6-4   frame_result_t of the last v2 frame
+//   bits 3-0   bytes taken from the ring, in eighths of its size, modulo 16
+//
+// The count only ever lags, so a host that counts what it has sent and keeps
+// no more than the ring size outstanding can never overrun it. A frame's
+// result is current once the count has passed the end of the frame.
+#define STATUS_BUSY         0x80
+#define STATUS_RESULT_SHIFT 4
+#define STATUS_RESULT_MASK  0x70
+#define STATUS_CONSUMED     0x0F
+#define STATUS_UNITS        8   // of the ring
+
+uint16_t crc16(const uint8_t *data, uint16_t length, uint16_t crc = FRAME_CRC_INIT);
+
+#endif /* __FRAME_H__ */
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2017 David McKelvie.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __LINE_CACHE_H__
+#define __LINE_CACHE_H__
+#include <stdint.h>
+#include <string.h>
+
+//////////////////////////////////////////////////////////
+///
+///\brief   least recently used cache of rendered text
+///
+/// Keyed by the text. The caller calls invalidate() whenever a glyph
+/// changes so nothing drawn with the old one is found. Each entry holds up
+/// to Chars characters of text and Bytes of bitmap, longer text is never
+/// cached. Entries are few, so lookup is a linear compare and the victim
+/// is the entry with the oldest use stamp.
+///
+//////////////////////////////////////////////////////////
+template <uint8_t Entries, uint8_t Chars, uint16_t Bytes>
+class LineCache {
+public:
+  LineCache()
+  {
+    memset(entries, 0, sizeof(entries));
+    clock = 0;
+    hitCount = 0;
+    missCount = 0;
+  }
+
+  //////////////////////////////////////////////////////////
+  ///
+  ///\brief   look text up
+  ///
+  ///\return  its bitmap, or 0 on a miss or text too long to cache
+  ///
+  //////////////////////////////////////////////////////////
+  const uint8_t *find(const uint8_t *text, uint8_t length)
+  {
+    if (length > Chars) return 0;
+
+    for (uint8_t i = 0; i < Entries; i++) {
+      entry_t *entry = &entries[i];
+      if (entry->used && entry->length == length &&
+          !memcmp(entry->text, text, length)) {
+        entry->used = ++clock;
+        hitCount++;
+        return entry->bitmap;
+      }
+    }
+    missCount++;
+    return 0;
+  }
+
+  //////////////////////////////////////////////////////////
+  ///
+  ///\brief   take the least recently used entry for text
+  ///
+  ///\return  Bytes to render text into, 0 if it is too long to cache
+  ///
+  //////////////////////////////////////////////////////////
+  uint8_t *insert(const uint8_t *text, uint8_t length)
+  {
+    if (length > Chars) return 0;
+
+    entry_t *victim = &entries[0];
+    for (uint8_t i = 1; i < Entries; i++) {
+      if (entries[i].used < victim->used) {
+        victim = &entries[i];
+      }
+    }
+    memcpy(victim->text, text, length);
+    victim->length = length;
+    victim->used = ++clock;
+    return victim->bitmap;
+  }
+
+  //////////////////////////////////////////////////////////
+  ///
+  ///\brief   forget every entry, after a glyph changes
+  ///
+  //////////////////////////////////////////////////////////
+  void invalidate()
+  {
+    for (uint8_t i = 0; i < Entries; i++) {
+      entries[i].used = 0;
+    }
+  }
+
+  uint32_t hits() { return hitCount; }
+  uint32_t misses() { return missCount; }
+  void clearStats() { hitCount = missCount = 0; }
+
+private:
+  typedef struct {
+    uint32_t used;      // clock at the last hit or insert, 0 while empty
+    uint8_t length;
+    uint8_t text[Chars];
+    uint8_t bitmap[Bytes];
+  } entry_t;
+
+  entry_t entries[Entries];
+  uint32_t clock;
+  uint32_t hitCount;
+  uint32_t missCount;
+};
+
+#endif /* __LINE_CACHE_H__ */
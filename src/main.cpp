@@ -16,32 +16,75 @@
 #include <Arduino.h>
 #include <libmaple/dma.h>
 #include <SPI.h>
-#include <LEDMatrix.h>
+#include <StaticMatrix.h>
+#include <ScanEngine.h>
 #include <font.h>
 #include <buffer.h>
+#include <frame.h>
+#include <delta.h>
+#include <scheduler.h>
+#include <line_cache.h>
+#include <cycles.h>
+#include <Profile.h>
 #include <HardwareTimer.h>
+#ifdef NATIVE_HAL
+#include <Panel.h>
+#endif
 
 //TODO: HUB75 RGB display
-//      - 8 bit RGB with 'pwm'
+//      - 8 bit RGB needs 8 bit planes, 192 x 32 only has RAM for 1 or 2
 
 // bus stop display 3 x 64 x 32 = 192 x 32 = 24 bytes width, 32 height
 #define WIDTH   192   // pixels, 24 bytes
 #define HEIGHT  32    // pixels
+#define SCAN_ROWS 16  // rows lit at once, 16 on 1/16 scan modules
 #define CHAR_WIDTH  6 // including 1 pixel space to left
 #define CHAR_HEIGHT 8 // including 1 pixel space below
 #define DISP_WIDTH (WIDTH / CHAR_WIDTH) // display width in characters
+#define CANVAS_WIDTH 384 // pixels drawn into, lines longer than the display can scroll
+#define LINE_CHARS (CANVAS_WIDTH / CHAR_WIDTH)
+#define LINES (HEIGHT / CHAR_HEIGHT)
+#define SCHED_HZ 1000   // Timer2 rate, the scheduler's tick
+#define SCROLL_HZ 100   // scrolls and page dwells are timed in these ticks, divides SCHED_HZ
+#define PAGES 4         // stored pages, CANVAS_WIDTH * HEIGHT / 8 bytes of RAM each
+#define PLAYLIST_LEN 8  // pages in a rotation
+#define PAGE_LIVE 0xFF  // playlist entry showing what has been drawn
 #define LED_PIN PC14
 #define STX 2
 #define ETX 3
-#define BUFF_LEN  200
+#define BUFF_LEN  1024 // power of two, must hold a whole v2 frame. Blind senders up to 2MHz SPI, see tools/spi_throughput.cpp
+#define SPI_RX_DMA DMA_CH2 // SPI1_RX request
+#define SPI_TX_DMA DMA_CH3 // SPI1_TX request
 #define NON_ASCII_LEN 32 // number of ascii control characters available
+#define SCAN_BENCHMARK 0 // report scan() cycles per row on Serial at startup
+#define PRINT_BENCHMARK 0 // report printLine() cycles with and without the line cache at startup
+#define HUB75 0          // 1: RGB panel, drive G and B as well as R
+#define COLOUR_DEPTH 1   // bits per colour channel of PIXEL_LAYER pixels, each costs another 6K of scanbuf
+#define DOUBLE_BUFFER 0  // 1: draw off screen, CMD_COMMIT shows it. Costs 1536 + 6K per bit, over 20K of RAM unless PAGES is 1
+#define TILE_MAP 0       // 1: the sign is built from the modules in tiles[], not full width rows
+#define PIXEL_LAYER 0    // 1: CMD_DRAW_PIXELS colours pixels over the text. Costs 3K per bit
+#define PROCESS_BUDGET_US 250 // command processing per parse run, doubled per quarter of the ring in use
+#define STATS_REPORT_MS 0     // >0: print command to pixel latency and task overruns on Serial this often
+#define IDLE_REFRESH_HZ 240   // refresh rate once nothing has changed for IDLE_AFTER_MS, 0 keeps the full rate
+#define IDLE_AFTER_MS 1000
+#define LINE_CACHE 4          // rendered lines kept for repeated text, 0 for none. About 230 bytes each
+#define CYCLES_PER_US (F_CPU / 1000000)
+
+// loop() tasks in priority order, periods and deadlines in scheduler ticks.
+// Scanning is not one of them, the ScanEngine interrupts run ahead of all.
+#define PARSE_PERIOD      1   // SPI ring to parser, then the MISO status
+#define PARSE_DEADLINE    2
+#define RENDER_PERIOD     1   // dirty rows to the scan buffer, refresh rate
+#define RENDER_DEADLINE   4
+#define ANIMATE_PERIOD    (SCHED_HZ / SCROLL_HZ) // scrolling and the playlist
+#define ANIMATE_DEADLINE  ANIMATE_PERIOD
 
 // pin to display mapping
 #define PIN_A           PA13
 #define PIN_B           PA12
 #define PIN_C           PA11
 #define PIN_D           PA8
-#define PIN_OE          PB13
+#define PIN_OE          PB0     // Timer3 channel 3, see ScanEngine
 #define PIN_LAT         PB14
 #define PIN_CLK         PB15
 
@@ -60,6 +103,42 @@
 #define CMD_DISPLAY_ON 8
 #define CMD_DISPLAY_OFF 9
 #define CMD_RGB 10
+#define CMD_COMMIT 11
+#define CMD_DRAW_BITMAP 12  // v2 only: x, y, width, height (16 bit), rows of pixels
+#define CMD_UPLOAD_FRAME 13 // v2 only: the whole display buffer
+#define CMD_STATS 14        // print task overruns on Serial, profile counters need -D PROFILE=1
+#define CMD_SCROLL 15       // line, direction, pixels per second (0 stops and resets)
+#define CMD_BRIGHTNESS 16   // level, 0 dark to 255 full, gamma corrected
+#define CMD_PRINT_AT 17     // y, x (16 bit), text from pixel x, y
+#define CMD_FILL_RECT 18    // pixel (0 clears), x (16 bit), y, width (16 bit), height
+#define CMD_PRINT_FIELD 19  // format, x (16 bit), y, text padded or cut to the field
+#define FIELD_WIDTH 0x7F    // format: cells in the field
+#define FIELD_RIGHT 0x80    // format: right align, for numbers
+#define CMD_PAGE_SAVE 20    // page, store what has been drawn
+#define CMD_PAGE_UPLOAD 21  // v2 only: page, first row, whole canvas rows
+#define CMD_PLAYLIST 22     // v2 only: page, dwell in tenths (16 bit) per entry, none stops
+#define CMD_DELTA 23        // v2 only: see delta.h
+#define CMD_DRAW_PIXELS 24  // v2 only: x (16 bit), y, then red, green, blue per pixel rightwards
+
+#define SCROLL_LEFT 0
+#define SCROLL_RIGHT 1
+#define SCROLL_UP 2
+#define SCROLL_DOWN 3
+
+#define BITMAP_HEADER 8
+#define FRAME_PAYLOAD_MAX (BITMAP_HEADER + WIDTH * HEIGHT / 8)
+#define FRAME_WAIT_MS 100   // to wait for the rest of a frame
+
+typedef struct {
+  int8_t dx, dy;        // viewport step
+  uint8_t speed;        // pixels per second, 0 when still
+  uint16_t progress;    // speed * ticks not yet scrolled
+} scroll_t;
+
+typedef struct {
+  uint8_t page;   // PAGE_LIVE or a stored page
+  uint16_t dwell; // tenths of a second
+} playlist_entry_t;
 
 typedef enum {
   WAIT_FOR_STX,
@@ -68,7 +147,30 @@ typedef enum {
   GET_DATA,
 } processor_state_t;
 
-LEDMatrix matrix(
+typedef StaticMatrix<WIDTH, HEIGHT, SCAN_ROWS, 2 * SCAN_ROWS, CANVAS_WIDTH> Matrix;
+
+// drawing is one bit per pixel, only the pixel layer has more to show
+#if COLOUR_DEPTH > 1 && !PIXEL_LAYER
+#error "COLOUR_DEPTH above 1 needs PIXEL_LAYER"
+#endif
+
+#if HUB75
+Matrix matrix(
+  /* A */ PIN_A,
+  /* B */ PIN_B,
+  /* C */ PIN_C,
+  /* D */ PIN_D,
+  /* OE*/ PIN_OE,
+  /*LAT*/ PIN_LAT,
+  /*CLK*/ PIN_CLK,
+  /* R1*/ PIN_R1,
+  /* R2*/ PIN_R2,
+  /* G1*/ PIN_G1,
+  /* G2*/ PIN_G2,
+  /* B1*/ PIN_B1,
+  /* B2*/ PIN_B2);
+#else
+Matrix matrix(
   /* A */ PIN_A,
   /* B */ PIN_B,
   /* C */ PIN_C,
@@ -78,15 +180,93 @@ LEDMatrix matrix(
   /* R2*/ PIN_R2,
   /*LAT*/ PIN_LAT,
   /*CLK*/ PIN_CLK);
+#endif
 
-CircularBuffer buffer;
+ScanEngine engine(Timer1, Timer3);
+
+#if TILE_MAP
+// modules in chain order from the controller, here 64x32 1/16 scan modules
+// with the middle one mounted upside down
+const MatrixTile tiles[] = {
+  { 128, 0, TILE_ROTATE_0 },
+  { 64, 0, TILE_ROTATE_180 },
+  { 0, 0, TILE_ROTATE_0 },
+};
+#endif
+
+#ifdef NATIVE_HAL
+// simulated sign for the native build, the pins the matrix drives light it
+#if HUB75
+Panel panel(PIN_A, PIN_B, PIN_C, PIN_D, PIN_OE, PIN_LAT, PIN_CLK,
+            PIN_R1, PIN_R2, PIN_G1, PIN_G2, PIN_B1, PIN_B2, WIDTH, HEIGHT / 2);
+#else
+Panel panel(PIN_A, PIN_B, PIN_C, PIN_D, PIN_OE, PIN_LAT, PIN_CLK,
+            PIN_R1, PIN_R2, PANEL_NO_PIN, PANEL_NO_PIN, PANEL_NO_PIN, PANEL_NO_PIN, WIDTH, HEIGHT / 2);
+#endif
+#endif
+
+CircularBuffer<uint8_t, BUFF_LEN> buffer;
 
 // TODO: RED display has i bit per pixel, RGB needs 24 bits per pixel [R, G, B]
-uint8_t displaybuf[WIDTH * HEIGHT / 8] = {0};
-uint8_t bufferData[BUFF_LEN] = {0};
+uint8_t displaybuf[CANVAS_WIDTH * HEIGHT / 8] = {0};
+// one port word per clock and bit plane, upper and lower half rows are shifted together
+uint16_t scanbuf[Matrix::scanWords(COLOUR_DEPTH)] = {0};
+#if DOUBLE_BUFFER
+uint8_t frontbuf[CANVAS_WIDTH * HEIGHT / 8] = {0};
+uint16_t backScanbuf[Matrix::scanWords(COLOUR_DEPTH)] = {0};
+#endif
+#if PIXEL_LAYER
+// CMD_DRAW_PIXELS colours, a byte per scanbuf word
+uint8_t pixelbuf[Matrix::scanWords(COLOUR_DEPTH)] = {0};
+#endif
 uint8_t control[NON_ASCII_LEN][CHAR_HEIGHT] = {0};
+// shown in place of displaybuf by the playlist, switching is a pointer flip
+uint8_t pages[PAGES][CANVAS_WIDTH * HEIGHT / 8] = {{0}};
+
+static processor_state_t processor_state = WAIT_FOR_STX;
+static frame_result_t frame_result = FRAME_NONE;
+static bool frame_resync = false; // after a framing error, bytes are dropped up to the next SOH
+static uint16_t rx_tail = 0; // buffer index DMA has been accounted up to
+static volatile uint8_t spi_status = 0; // shifted out on MISO, see frame.h
+static scroll_t scroll[LINES + 1]; // indexed by line, each line is a viewport zone
+static volatile uint16_t scroll_ticks = 0;
+static playlist_entry_t playlist[PLAYLIST_LEN];
+static uint8_t playlist_length = 0; // 0: show what has been drawn
+static uint8_t playlist_index = 0;
+static uint32_t playlist_elapsed = 0; // timer ticks on the current entry
+static volatile uint16_t page_ticks = 0;
+static uint8_t scroll_divider = 0; // scheduler ticks to the next scroll tick
+
+Scheduler scheduler;
+static int8_t parse_task = -1;
+static int8_t render_task = -1;
 
-static volatile uint8_t command_count = 0;
+// command to pixel latency, from input arriving to its rows being encoded
+static bool input_pending = false;
+static uint32_t input_since = 0;
+static uint32_t latency_count = 0;
+static uint32_t latency_total = 0;
+static uint32_t latency_worst = 0;
+
+// scan rows the render task encoded and the updates that encoded any
+static uint32_t render_encoded = 0;
+static uint32_t render_updates = 0;
+
+#if LINE_CACHE
+// text up to a display width, CHAR_HEIGHT rows of its cells
+LineCache<LINE_CACHE, DISP_WIDTH, (DISP_WIDTH * CHAR_WIDTH + 7) / 8 * CHAR_HEIGHT> line_cache;
+#endif
+
+static bool scanning = false; // the scan engine took the matrix, frames complete
+
+// show what has been drawn. Without the scan engine no frame completes to
+// swap the buffers, and input held for the swap would never resume.
+void commitDisplay()
+{
+  if (scanning) {
+    matrix.commit();
+  }
+}
 
 void overRideControlCharacter(uint8_t index, uint8_t *bitmap)
 {
@@ -96,17 +276,95 @@ void overRideControlCharacter(uint8_t index, uint8_t *bitmap)
   for (uint8_t i = 0; i < CHAR_HEIGHT; i++) {
     control[index][i] = bitmap[i];
   }
+#if LINE_CACHE
+  // lines drawn with the old glyph
+  line_cache.invalidate();
+#endif
+}
+
+const uint8_t *glyph(uint8_t character)
+{
+  static const uint8_t blank[CHAR_HEIGHT] = {0};
+
+  if (character < 0x20) {
+    return control[character];
+  } else if (character < 0x7F) {
+    return ASCII[character - 0x20];
+  }
+  return blank;
 }
 
 void putch(uint8_t x, uint8_t y, char character)
 {
-  if (character >= 0 && character < 0x20) {
-    matrix.drawImage(x, y, CHAR_WIDTH, CHAR_HEIGHT, control[character]);
-  } else if (character > 0x1F && character < 0x7F) {
-    matrix.drawImage(x, y, CHAR_WIDTH, CHAR_HEIGHT, ASCII[character - 0x20]);
+  if ((uint8_t) character < 0x7F) {
+    matrix.drawImage(x, y, CHAR_WIDTH, CHAR_HEIGHT, glyph(character));
   }
 }
 
+// CHAR_HEIGHT rows of (length * CHAR_WIDTH + 7) / 8 bytes. Four cells are
+// exactly 3 bytes wide, so each group of four is written with whole bytes.
+void renderCells(const uint8_t *message, uint8_t length, uint8_t *out)
+{
+  for (uint8_t row = 0; row < CHAR_HEIGHT; row++) {
+    for (uint8_t i = 0; i < length; i += 4) {
+      uint8_t cells = (length - i) < 4 ? (length - i) : 4;
+      uint8_t bytes = (cells * CHAR_WIDTH + 7) / 8;
+      uint32_t bits = 0;
+
+      for (uint8_t cell = 0; cell < cells; cell++) {
+        // glyph rows are left aligned, the top 6 bits are the cell
+        bits |= (uint32_t)(glyph(message[i + cell])[row] >> 2) << (18 - cell * CHAR_WIDTH);
+      }
+      for (uint8_t byte = 0; byte < bytes; byte++) {
+        *out++ = bits >> (16 - byte * 8);
+      }
+    }
+  }
+}
+
+// text is rendered into byte aligned 24 x 8 blocks, each drawn as it is done
+void drawCells(uint16_t x, uint8_t y, const uint8_t *message, uint8_t length)
+{
+  uint8_t block[3 * CHAR_HEIGHT];
+
+  for (uint8_t i = 0; i < length; i += 4) {
+    uint8_t cells = (length - i) < 4 ? (length - i) : 4;
+    renderCells(message + i, cells, block);
+    matrix.drawImage(x + i * CHAR_WIDTH, y, cells * CHAR_WIDTH, CHAR_HEIGHT, block);
+  }
+}
+
+// repeated text is drawn from the line cache, a byte aligned repeat is a
+// copy of each row
+void printCells(uint16_t x, uint8_t y, const uint8_t *message, uint8_t length)
+{
+  PROFILE_SCOPE(PROFILE_PRINT);
+#if LINE_CACHE
+  const uint8_t *bitmap = line_cache.find(message, length);
+  if (!bitmap) {
+    uint8_t *entry = line_cache.insert(message, length);
+    if (entry) {
+      renderCells(message, length, entry);
+    }
+    bitmap = entry;
+  }
+  if (bitmap) {
+    matrix.drawImage(x, y, length * CHAR_WIDTH, CHAR_HEIGHT, bitmap);
+    return;
+  }
+#endif
+  drawCells(x, y, message, length);
+}
+
+uint8_t textLength(const uint8_t *message)
+{
+  uint8_t length = 0;
+  while (length < LINE_CHARS && message[length]) {
+    length++;
+  }
+  return length;
+}
+
 void printLine(uint8_t line, String message)
 {
   // convert input, line, into x and y
@@ -115,61 +373,261 @@ void printLine(uint8_t line, String message)
   // line 3: x = 0, y = 16
   // line 4: x = 0, y = 24
   uint8_t linePixel = (line - 1) * CHAR_HEIGHT;
-  for (uint8_t i = 0; i < message.length(); i++) {
-      putch(i * CHAR_WIDTH, linePixel, message.charAt(i));
-  }
+  const uint8_t *text = (const uint8_t *) message.c_str();
+  printCells(0, linePixel, text, textLength(text));
 }
 
 void printLine(volatile uint8_t *message) {
   uint8_t linePixel = (message[0] - 1) * CHAR_HEIGHT;
-  for (int i = 0; i < DISP_WIDTH && message[i + 1]; i++) {
-      putch(i * CHAR_WIDTH, linePixel, message[i + 1]);
-  }
+  const uint8_t *text = (const uint8_t *) message + 1;
+  printCells(0, linePixel, text, textLength(text));
 }
 
 void printLine(uint8_t line, uint8_t *message) {
   uint8_t linePixel = (line - 1) * CHAR_HEIGHT;
-  for (int i = 0; i < DISP_WIDTH && message[i]; i++) {
-      putch(i * CHAR_WIDTH, linePixel, message[i]);
-  }
+  printCells(0, linePixel, message, textLength(message));
 }
 
+void clearLine(uint8_t line)
+{
+  if (line < 1 || line > LINES) return;
+
+  uint8_t y = (line - 1) * CHAR_HEIGHT;
+  matrix.drawRect(0, y, CANVAS_WIDTH, y + CHAR_HEIGHT, 0);
+}
+
+void printAt(uint16_t x, uint8_t y, const uint8_t *text, uint16_t length)
+{
+  printCells(x, y, text, length < LINE_CHARS ? length : LINE_CHARS);
+}
+
+// rewrite a field of whole cells, so a countdown only sends the digits that
+// change and the field's old contents never need clearing
+void printField(uint16_t x, uint8_t y, uint8_t format, const uint8_t *text, uint16_t length)
+{
+  uint8_t cells[LINE_CHARS];
+  uint8_t width = format & FIELD_WIDTH;
+
+  if (width > LINE_CHARS) width = LINE_CHARS;
+  if (length > width) length = width;
+
+  memset(cells, ' ', width);
+  memcpy(cells + ((format & FIELD_RIGHT) ? width - length : 0), text, length);
+  printCells(x, y, cells, width);
+}
+
+void fillRect(uint8_t pixel, uint16_t x, uint8_t y, uint16_t width, uint8_t height)
+{
+  uint32_t right = (uint32_t) x + width;
+  matrix.drawRect(x, y, right > CANVAS_WIDTH ? CANVAS_WIDTH : right, y + height, pixel);
+}
+
+void spiReceived();
+
+// SPI1 receives straight into the ring buffer with a circular DMA channel, the
+// half and full transfer interrupts make sure a wrap is never missed. A second
+// channel answers every byte with the status byte.
 void initSpi()
 {
   SPI.setModule(1);
   SPI.setClockDivider(SPI_CLOCK_DIV16);
   SPI.beginSlave();
-  spi_irq_enable(SPI.dev(), SPI_RXNE_INTERRUPT);
+
+  dma_init(DMA1);
+  dma_setup_transfer(DMA1, SPI_RX_DMA, &SPI.dev()->regs->DR, DMA_SIZE_8BITS,
+                     buffer.storage(), DMA_SIZE_8BITS,
+                     DMA_MINC_MODE | DMA_CIRC_MODE | DMA_HALF_TRNS | DMA_TRNS_CMPLT);
+  dma_set_num_transfers(DMA1, SPI_RX_DMA, BUFF_LEN);
+  dma_attach_interrupt(DMA1, SPI_RX_DMA, spiReceived);
+  dma_enable(DMA1, SPI_RX_DMA);
+  spi_rx_dma_enable(SPI.dev());
+
+  dma_setup_transfer(DMA1, SPI_TX_DMA, &SPI.dev()->regs->DR, DMA_SIZE_8BITS,
+                     &spi_status, DMA_SIZE_8BITS, DMA_CIRC_MODE | DMA_FROM_MEM);
+  dma_set_num_transfers(DMA1, SPI_TX_DMA, 1);
+  dma_enable(DMA1, SPI_TX_DMA);
+  spi_tx_dma_enable(SPI.dev());
 }
 
-extern "C" {
-  void __irq_spi1(void);
+// publish the bytes DMA has written since the last call. Called from the
+// DMA interrupt and with interrupts off in loop()
+void spiReceived()
+{
+  PROFILE_SCOPE(PROFILE_SPI);
+  uint16_t tail = BUFF_LEN - dma_get_count(DMA1, SPI_RX_DMA);
+  if (tail == BUFF_LEN) {
+    tail = 0;
+  }
+
+  buffer.produce((tail + BUFF_LEN - rx_tail) % BUFF_LEN);
+  rx_tail = tail;
+  PROFILE_LEVEL(buffer.pending());
+}
+
+// refresh what MISO reports, from loop() as the ring is only read there
+void updateStatus()
+{
+  uint8_t status = (buffer.consumed() / (BUFF_LEN / STATUS_UNITS)) & STATUS_CONSUMED;
+  status |= (frame_result << STATUS_RESULT_SHIFT) & STATUS_RESULT_MASK;
+  if (buffer.available() || processor_state != WAIT_FOR_STX) {
+    status |= STATUS_BUSY;
+  }
+  spi_status = status;
+}
+
+void schedulerTick()
+{
+  scheduler.tick();
+  if (++scroll_divider == SCHED_HZ / SCROLL_HZ) {
+    scroll_divider = 0;
+    scroll_ticks++;
+    page_ticks++;
+  }
+}
+
+// each text line is shown through its own viewport, scrolling moves the
+// viewport across the canvas so nothing is redrawn
+void initScroll()
+{
+  for (uint8_t line = 1; line <= LINES; line++) {
+    uint8_t y = (line - 1) * CHAR_HEIGHT;
+    matrix.setViewport(line, y, CHAR_HEIGHT, 0, y);
+  }
+}
+
+void setScroll(uint8_t line, uint8_t direction, uint8_t speed)
+{
+  static const int8_t steps[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+
+  if (line < 1 || line > LINES || direction > SCROLL_DOWN) return;
+
+  scroll_t *s = &scroll[line];
+  s->dx = steps[direction][0];
+  s->dy = steps[direction][1];
+  s->speed = speed;
+  s->progress = 0;
+  if (!speed) {
+    uint8_t y = (line - 1) * CHAR_HEIGHT;
+    matrix.setViewport(line, y, CHAR_HEIGHT, 0, y);
+  }
+}
+
+// move the scrolling lines on by the timer ticks since the last call
+void applyScroll()
+{
+  noInterrupts();
+  uint16_t ticks = scroll_ticks;
+  scroll_ticks = 0;
+  interrupts();
+
+  if (!ticks) return;
+
+  for (uint8_t line = 1; line <= LINES; line++) {
+    scroll_t *s = &scroll[line];
+    if (!s->speed) continue;
+
+    s->progress += s->speed * ticks;
+    int16_t pixels = s->progress / SCROLL_HZ;
+    s->progress %= SCROLL_HZ;
+    if (pixels) {
+      matrix.scrollViewport(line, s->dx * pixels, s->dy * pixels);
+    }
+  }
+}
+
+uint16_t le16(const uint8_t *data)
+{
+  return data[0] | (data[1] << 8);
+}
+
+void showPage(uint8_t page)
+{
+  matrix.show(page < PAGES ? pages[page] : 0);
+}
+
+void savePage(uint8_t page)
+{
+  if (page >= PAGES) return;
+  memcpy(pages[page], displaybuf, sizeof(pages[page]));
+}
+
+bool uploadPage(const uint8_t *payload, uint16_t length)
+{
+  // page, first row, rows of CANVAS_WIDTH / 8 bytes
+  const uint16_t stride = CANVAS_WIDTH / 8;
+  if (length < 2 || payload[0] >= PAGES || (length - 2) % stride) return false;
+
+  uint16_t rows = (length - 2) / stride;
+  if (payload[1] + rows > HEIGHT) return false;
+  memcpy(pages[payload[0]] + payload[1] * stride, payload + 2, length - 2);
+  return true;
 }
 
-void __irq_spi1(void)
+bool setPlaylist(const uint8_t *payload, uint16_t length)
 {
-  uint16_t reg = spi_rx_reg(SPI.dev());
-  spi_tx_reg(SPI.dev(), reg);
+  if (length % 3 || length / 3 > PLAYLIST_LEN) return false;
 
-  uint8_t b = (uint8_t) (reg & 0xFF);
-  buffer.put(b);
-  if (b == ETX) {
-    command_count++;
+  uint8_t count = length / 3;
+  for (uint8_t i = 0; i < count; i++) {
+    uint8_t page = payload[i * 3];
+    if (page >= PAGES && page != PAGE_LIVE) return false;
   }
+  for (uint8_t i = 0; i < count; i++) {
+    playlist[i].page = payload[i * 3];
+    playlist[i].dwell = le16(payload + i * 3 + 1);
+  }
+  playlist_length = count;
+  playlist_index = 0;
+  playlist_elapsed = 0;
+  showPage(count ? playlist[0].page : PAGE_LIVE);
+  return true;
+}
+
+// move the playlist on once the current page has had its dwell
+void applyPlaylist()
+{
+  noInterrupts();
+  uint16_t ticks = page_ticks;
+  page_ticks = 0;
+  interrupts();
+
+  if (playlist_length < 2) return;
+
+  playlist_elapsed += ticks;
+  uint32_t dwell = (uint32_t) playlist[playlist_index].dwell * SCROLL_HZ / 10;
+  if (playlist_elapsed < dwell) return;
+
+  playlist_elapsed = 0;
+  playlist_index = (playlist_index + 1) % playlist_length;
+  showPage(playlist[playlist_index].page);
 }
 
+// bytes of binary data a v1 command takes before its ETX, they may be ETX
+uint8_t fixedData(uint8_t command)
+{
+  switch (command) {
+    case CMD_SCROLL:      return 2;
+    case CMD_PRINT_AT:    return 2;
+    case CMD_FILL_RECT:   return 6;
+    case CMD_PRINT_FIELD: return 3;
+    default:              return 0;
+  }
+}
+
+void reportStats();
+
 void process_character(uint8_t character) {
-  static processor_state_t state = WAIT_FOR_STX;
+  PROFILE_SCOPE(PROFILE_PROCESS);
   static uint8_t command = 0;
   static uint8_t param = 0;
   static uint8_t lineBuffer[64];
   static uint8_t index = 0;
 
-  switch (state) {
+  switch (processor_state) {
     case WAIT_FOR_STX:
     if (character == STX) {
       command = param = index = 0;
-      state = GET_COMMAND;
+      processor_state = GET_COMMAND;
     }
     break;
 
@@ -181,27 +639,45 @@ void process_character(uint8_t character) {
       case CMD_PRINT_LINE:
       case CMD_CLEAR_LINE:
       case CMD_SET_CHARACTER:
-      state = GET_PARAM;
+      case CMD_RGB:
+      case CMD_SCROLL:
+      case CMD_BRIGHTNESS:
+      case CMD_PRINT_AT:
+      case CMD_FILL_RECT:
+      case CMD_PRINT_FIELD:
+      case CMD_PAGE_SAVE:
+      processor_state = GET_PARAM;
       break;
 
       // commands without
       case CMD_CLEAR_DISP:
       matrix.clear();
-      state = WAIT_FOR_STX;
+      matrix.clearPixels();
+      processor_state = WAIT_FOR_STX;
       break;
 
       case CMD_DISPLAY_ON:
       matrix.on();
-      state = WAIT_FOR_STX;
+      processor_state = WAIT_FOR_STX;
       break;
 
       case CMD_DISPLAY_OFF:
       matrix.off();
-      state = WAIT_FOR_STX;
+      processor_state = WAIT_FOR_STX;
+      break;
+
+      case CMD_COMMIT:
+      commitDisplay();
+      processor_state = WAIT_FOR_STX;
+      break;
+
+      case CMD_STATS:
+      reportStats();
+      processor_state = WAIT_FOR_STX;
       break;
 
       default:
-      state = WAIT_FOR_STX;
+      processor_state = WAIT_FOR_STX;
       break;
     }
     break;
@@ -211,12 +687,32 @@ void process_character(uint8_t character) {
     switch (command) {
       case CMD_PRINT_LINE:
       case CMD_SET_CHARACTER:
-      state = GET_DATA;
+      case CMD_SCROLL:
+      case CMD_PRINT_AT:
+      case CMD_FILL_RECT:
+      case CMD_PRINT_FIELD:
+      processor_state = GET_DATA;
       break;
 
       case CMD_CLEAR_LINE:
-      // TODO: clear line
-      state = WAIT_FOR_STX;
+      clearLine(param);
+      processor_state = WAIT_FOR_STX;
+      break;
+
+      case CMD_RGB:
+      // param: background colour << 4 | foreground colour
+      matrix.setColour(param & 0x07, (param >> 4) & 0x07);
+      processor_state = WAIT_FOR_STX;
+      break;
+
+      case CMD_BRIGHTNESS:
+      engine.setBrightness(param);
+      processor_state = WAIT_FOR_STX;
+      break;
+
+      case CMD_PAGE_SAVE:
+      savePage(param);
+      processor_state = WAIT_FOR_STX;
       break;
 
       default:
@@ -225,51 +721,630 @@ void process_character(uint8_t character) {
     break;
 
     case GET_DATA:
-    if (character == ETX) {
-      noInterrupts();
-      command_count--;
-      interrupts();
+    if (character == ETX && index >= fixedData(command)) {
       lineBuffer[index] = 0;
-      state = WAIT_FOR_STX;
+      processor_state = WAIT_FOR_STX;
       if (command == CMD_PRINT_LINE) {
         printLine(param, lineBuffer);
       } else if (command == CMD_SET_CHARACTER) {
         overRideControlCharacter(param, lineBuffer);
+      } else if (command == CMD_SCROLL && index == 2) {
+        setScroll(param, lineBuffer[0], lineBuffer[1]);
+      } else if (command == CMD_PRINT_AT) {
+        printAt(le16(lineBuffer), param, lineBuffer + 2, index - 2);
+      } else if (command == CMD_FILL_RECT && index == 6) {
+        fillRect(param, le16(lineBuffer), lineBuffer[2], le16(lineBuffer + 3), lineBuffer[5]);
+      } else if (command == CMD_PRINT_FIELD) {
+        printField(le16(lineBuffer), lineBuffer[2], param, lineBuffer + 3, index - 3);
       }
     } else {
       lineBuffer[index++] = character;
       if (index > 63) {
-        state = WAIT_FOR_STX;
+        processor_state = WAIT_FOR_STX;
       }
     }
     break;
 
     default:
-    state = WAIT_FOR_STX;
+    processor_state = WAIT_FOR_STX;
     break;
   }
 }
 
+// apply a v2 frame, the payload has already passed its CRC
+frame_result_t dispatchFrame(uint8_t command, const uint8_t *payload, uint16_t length)
+{
+  switch (command) {
+    case CMD_PRINT_LINE: {
+      // line, text
+      uint8_t text[LINE_CHARS + 1];
+      if (length < 1) return FRAME_NAK;
+      uint8_t count = (length - 1) < LINE_CHARS ? (length - 1) : LINE_CHARS;
+      memcpy(text, payload + 1, count);
+      text[count] = 0;
+      printLine(payload[0], text);
+      break;
+    }
+
+    case CMD_SET_CHARACTER:
+    // index, CHAR_HEIGHT rows
+    if (length != 1 + CHAR_HEIGHT) return FRAME_NAK;
+    overRideControlCharacter(payload[0], (uint8_t *) payload + 1);
+    break;
+
+    case CMD_RGB:
+    if (length != 1) return FRAME_NAK;
+    matrix.setColour(payload[0] & 0x07, (payload[0] >> 4) & 0x07);
+    break;
+
+    case CMD_CLEAR_LINE:
+    if (length != 1) return FRAME_NAK;
+    clearLine(payload[0]);
+    break;
+
+    case CMD_PRINT_AT:
+    if (length < 3) return FRAME_NAK;
+    printAt(le16(payload + 1), payload[0], payload + 3, length - 3);
+    break;
+
+    case CMD_FILL_RECT:
+    if (length != 7) return FRAME_NAK;
+    fillRect(payload[0], le16(payload + 1), payload[3], le16(payload + 4), payload[6]);
+    break;
+
+    case CMD_PRINT_FIELD:
+    if (length < 4) return FRAME_NAK;
+    printField(le16(payload + 1), payload[3], payload[0], payload + 4, length - 4);
+    break;
+
+    case CMD_PAGE_SAVE:
+    if (length != 1 || payload[0] >= PAGES) return FRAME_NAK;
+    savePage(payload[0]);
+    break;
+
+    case CMD_PAGE_UPLOAD:
+    if (!uploadPage(payload, length)) return FRAME_NAK;
+    break;
+
+    case CMD_PLAYLIST:
+    if (!setPlaylist(payload, length)) return FRAME_NAK;
+    break;
+
+    case CMD_CLEAR_DISP:
+    matrix.clear();
+    matrix.clearPixels();
+    break;
+
+    case CMD_DISPLAY_ON:
+    matrix.on();
+    break;
+
+    case CMD_DISPLAY_OFF:
+    matrix.off();
+    break;
+
+    case CMD_COMMIT:
+    commitDisplay();
+    break;
+
+    case CMD_DRAW_BITMAP: {
+      if (length < BITMAP_HEADER) return FRAME_NAK;
+      uint16_t width = le16(payload + 4);
+      uint16_t height = le16(payload + 6);
+      if (length != BITMAP_HEADER + (width + 7) / 8 * height) return FRAME_NAK;
+      matrix.drawImage(le16(payload), le16(payload + 2), width, height, payload + BITMAP_HEADER);
+      break;
+    }
+
+    case CMD_DELTA: {
+      PROFILE_SCOPE(PROFILE_DECODE);
+      if (length < DELTA_HEADER) return FRAME_NAK;
+      uint16_t x = le16(payload + 1);
+      uint16_t y = le16(payload + 3);
+      uint16_t width = le16(payload + 5);
+      uint16_t height = le16(payload + 7);
+      if ((x | width) % 8 || x + width > CANVAS_WIDTH || y + height > HEIGHT) return FRAME_NAK;
+      const uint8_t *runs = payload + DELTA_HEADER;
+      if (!delta_check(runs, length - DELTA_HEADER, (uint32_t) width / 8 * height)) return FRAME_NAK;
+      uint8_t *rows = matrix.openRows(y, y + height);
+      delta_decode(rows + x / 8, CANVAS_WIDTH / 8, width / 8, payload[0], runs, length - DELTA_HEADER);
+      break;
+    }
+
+#if PIXEL_LAYER
+    case CMD_DRAW_PIXELS: {
+      if (length < 6 || (length - 3) % 3) return FRAME_NAK;
+      uint16_t x = le16(payload);
+      uint8_t y = payload[2];
+      uint16_t count = (length - 3) / 3;
+      if (x + count > WIDTH || y >= HEIGHT) return FRAME_NAK;
+      for (const uint8_t *rgb = payload + 3; count--; rgb += 3) {
+        matrix.drawPixel(x++, y, rgb[0], rgb[1], rgb[2]);
+      }
+      break;
+    }
+#endif
+
+    case CMD_UPLOAD_FRAME:
+    if (length != WIDTH * HEIGHT / 8) return FRAME_NAK;
+    matrix.drawImage(0, 0, WIDTH, HEIGHT, payload);
+    break;
+
+    case CMD_SCROLL:
+    if (length != 3) return FRAME_NAK;
+    setScroll(payload[0], payload[1], payload[2]);
+    break;
+
+    case CMD_BRIGHTNESS:
+    if (length != 1) return FRAME_NAK;
+    engine.setBrightness(payload[0]);
+    break;
+
+    case CMD_STATS:
+    reportStats();
+    break;
+
+    default:
+    return FRAME_NAK;
+  }
+  return FRAME_ACK;
+}
+
+// a v2 frame starts at the oldest byte in the buffer, apply it once it has
+// all arrived. Returns false while waiting for the rest of it. After a
+// framing error processInput() drops everything up to the next SOH.
+bool processFrame()
+{
+  static uint8_t frame[FRAME_PAYLOAD_MAX + FRAME_OVERHEAD];
+  static uint32_t waitStart = 0;
+  static bool waiting = false;
+
+  uint16_t available = buffer.peek(frame, FRAME_HEADER);
+  uint16_t length = le16(frame + 1);
+
+  if (available == FRAME_HEADER && length > FRAME_PAYLOAD_MAX) {
+    frame_result = FRAME_TOO_LONG;
+    buffer.skip(1);                     // resynchronise on the next SOH
+    frame_resync = true;
+    return true;
+  }
+
+  if (available < FRAME_HEADER || buffer.available() < length + FRAME_OVERHEAD) {
+    if (!waiting) {
+      waiting = true;
+      waitStart = millis();
+    } else if (millis() - waitStart > FRAME_WAIT_MS) {
+      waiting = false;
+      frame_result = FRAME_TIMEOUT;
+      buffer.skip(1);
+      frame_resync = true;
+      return true;
+    }
+    return false;
+  }
+  waiting = false;
+
+  buffer.peek(frame, length + FRAME_OVERHEAD);
+
+  // a bad CRC may be a corrupt length, so only the SOH is dropped and the
+  // next frame can start anywhere in what followed it
+  const uint8_t *crc = frame + FRAME_HEADER + 1 + length;
+  if (crc16(frame + 1, length + 3) != le16(crc)) {
+    frame_result = FRAME_CRC_ERROR;
+    buffer.skip(1);
+    frame_resync = true;
+    return true;
+  }
+
+  buffer.skip(length + FRAME_OVERHEAD);
+  frame_result = dispatchFrame(frame[FRAME_HEADER], frame + FRAME_HEADER + 1, length);
+  return true;
+}
+
+// hand received bytes to the v1 parser until a v2 frame starts between
+// commands. Stops once budget cycles have been used, whatever is left is
+// picked up on the next run. Returns true if it stopped for the budget.
+// After a commit nothing more is taken until the scan interrupt has swapped
+// the buffers, so the next command cannot draw into the one being shown.
+bool processInput(uint32_t budget)
+{
+  uint32_t start = cycles_now();
+  const uint8_t *data;
+  uint16_t count;
+
+  while (!matrix.isCommitPending() && (count = buffer.contiguous(&data)) > 0) {
+    if (frame_resync) {
+      // the rest of a bad frame, none of it goes to the v1 parser
+      const uint8_t *soh = (const uint8_t *) memchr(data, SOH, count);
+      buffer.skip(soh ? soh - data : count);
+      frame_resync = !soh;
+      continue;
+    }
+
+    uint16_t i = 0;
+    while (i < count && !(data[i] == SOH && processor_state == WAIT_FOR_STX)) {
+      process_character(data[i++]);
+      if (matrix.isCommitPending()) {
+        buffer.skip(i);
+        return false;
+      }
+      if (cycles_now() - start >= budget) {
+        buffer.skip(i);
+        return true;
+      }
+    }
+    buffer.skip(i);
+
+    if (i < count && !processFrame()) {
+      // the rest of the frame has not arrived
+      return false;
+    }
+    if (cycles_now() - start >= budget) {
+      return buffer.available() > 0;
+    }
+  }
+  return false;
+}
+
+// the fuller the ring gets, the more of each pass goes to draining it, so a
+// burst cannot lap the parser while the display stays responsive
+uint32_t processBudget()
+{
+  uint32_t budget = PROCESS_BUDGET_US * CYCLES_PER_US;
+  return budget << (buffer.available() * 4 / BUFF_LEN);
+}
+
+void recordLatency(uint32_t cycles)
+{
+  latency_count++;
+  latency_total += cycles / CYCLES_PER_US;
+  if (cycles > latency_worst) {
+    latency_worst = cycles;
+  }
+}
+
+// one line per task, the scan rows encoded, then with PROFILE one per
+// profiled section, the row period and ring high water mark. Counters start
+// again from zero after each report.
+void reportStats()
+{
+  for (uint8_t i = 0; i < scheduler.count(); i++) {
+    const task_t *task = scheduler.task(i);
+    Serial.print(task->name);
+    Serial.print(": runs ");
+    Serial.print(task->runs);
+    Serial.print(" overruns ");
+    Serial.print(task->overruns);
+    Serial.print(" worst ");
+    Serial.print(task->worst);
+    Serial.println(" ticks");
+  }
+  scheduler.clearStats();
+
+  // how much of the display the updates touch, matrix.rows() each is all of it
+  Serial.print("rows: encoded ");
+  Serial.print(render_encoded);
+  Serial.print(" in ");
+  Serial.print(render_updates);
+  Serial.print(" updates, waiting ");
+  Serial.println(matrix.dirtyRows());
+  render_encoded = 0;
+  render_updates = 0;
+
+#if LINE_CACHE
+  Serial.print("line cache: hits ");
+  Serial.print(line_cache.hits());
+  Serial.print(" misses ");
+  Serial.println(line_cache.misses());
+  line_cache.clearStats();
+#endif
+
+#if PROFILE
+  for (uint8_t i = 0; i < PROFILE_SECTIONS; i++) {
+    profile_stat_t *stat = &profile_stats[i];
+    Serial.print(profile_names[i]);
+    Serial.print(": calls ");
+    Serial.print(stat->calls);
+    Serial.print(" avg ");
+    Serial.print((uint32_t)(stat->calls ? stat->cycles / stat->calls : 0));
+    Serial.print(" max ");
+    Serial.println(stat->max);
+  }
+
+  profile_period_t *period = &profile_row_period;
+  Serial.print("row period: min ");
+  Serial.print(period->min);
+  Serial.print(" avg ");
+  Serial.print((uint32_t)(period->count ? period->total / period->count : 0));
+  Serial.print(" max ");
+  Serial.println(period->max);
+
+  Serial.print("ring high water: ");
+  Serial.println(profile_high_water);
+
+  profile_reset();
+#endif
+}
+
+#ifndef NATIVE_HAL
+extern "C" void *_sbrk(int incr);
+#endif
+
+// RAM the display takes, PAGES is the part to trade against the rest
+void reportMemory()
+{
+  uint32_t display = sizeof(displaybuf) + sizeof(scanbuf);
+#if DOUBLE_BUFFER
+  display += sizeof(frontbuf) + sizeof(backScanbuf);
+#endif
+#if PIXEL_LAYER
+  display += sizeof(pixelbuf);
+#endif
+  Serial.print("RAM: pages ");
+  Serial.print((uint32_t) sizeof(pages));
+  Serial.print(" display ");
+  Serial.print(display);
+  Serial.print(" ring ");
+  Serial.print(BUFF_LEN);
+#if LINE_CACHE
+  Serial.print(" line cache ");
+  Serial.print((uint32_t) sizeof(line_cache));
+#endif
+#ifndef NATIVE_HAL
+  char top;
+  Serial.print(" free ");
+  Serial.print((uint32_t)(&top - (char *) _sbrk(0)));
+#endif
+  Serial.println();
+}
+
+void reportLatency()
+{
+  Serial.print("latency us avg: ");
+  Serial.print(latency_count ? latency_total / latency_count : 0);
+  Serial.print(" max: ");
+  Serial.print(latency_worst / CYCLES_PER_US);
+  Serial.print(" commands: ");
+  Serial.println(latency_count);
+  latency_count = latency_total = latency_worst = 0;
+}
+
+// full refresh rate while the picture is changing, IDLE_REFRESH_HZ once it
+// has been still for IDLE_AFTER_MS. Brightness is the same at either rate.
+void applyRefresh(bool changed)
+{
+#if IDLE_REFRESH_HZ
+  static uint32_t still_since = 0;
+
+  if (changed) {
+    still_since = millis();
+    engine.setSlowdown(1);
+  } else if (millis() - still_since >= IDLE_AFTER_MS) {
+    uint32_t factor = engine.refreshRate() / IDLE_REFRESH_HZ;
+    engine.setSlowdown(factor > 255 ? 255 : factor);
+  }
+#endif
+}
+
+// nothing released until an interrupt: the next scan row, a scheduler tick
+// or the receive DMA at half or end of the ring. Bytes arriving in between
+// wait for the next parse release, at most PARSE_PERIOD ticks.
+void waitForInterrupt()
+{
+  PROFILE_SCOPE(PROFILE_SLEEP);
+#ifndef NATIVE_HAL
+  asm volatile ("wfi");
+#endif
+}
+
+#if SCAN_BENCHMARK
+// the original digitalWrite() shift loop, kept as the baseline
+void scanDigitalWrite()
+{
+  for (uint16_t x = 0; x < WIDTH; x++) {
+    digitalWrite(PIN_CLK, LOW);
+    digitalWrite(PIN_R1, displaybuf[x / 8] & (0x80 >> (x % 8)));
+    digitalWrite(PIN_CLK, HIGH);
+  }
+}
+
+void benchmarkScan()
+{
+  const uint8_t rows = 16;
+  uint32_t start;
+
+  start = cycles_now();
+  for (uint8_t row = 0; row < rows; row++) {
+    scanDigitalWrite();
+  }
+  Serial.print("digitalWrite: ");
+  Serial.println((cycles_now() - start) / rows);
+
+  start = cycles_now();
+  for (uint8_t row = 0; row < rows; row++) {
+    matrix.scan();
+  }
+  Serial.print("BSRR: ");
+  Serial.println((cycles_now() - start) / rows);
+
+  start = cycles_now();
+  for (uint8_t row = 0; row < rows; row++) {
+    matrix.scan<PIN_CLK, PIN_R1, PIN_R2>();
+  }
+  Serial.print("FastPin: ");
+  Serial.println((cycles_now() - start) / rows);
+}
+#endif
+
+#if PRINT_BENCHMARK
+// one departure line printed over and over, the way a sign cycles its
+// messages, one character at a time, in blocks and from the line cache
+void benchmarkPrint()
+{
+  const uint8_t *text = (const uint8_t *) "12  City Centre     3 min";
+  const uint8_t length = textLength(text);
+  const uint8_t prints = 100;
+  uint32_t start;
+
+  start = cycles_now();
+  for (uint8_t i = 0; i < prints; i++) {
+    for (uint8_t c = 0; c < length; c++) {
+      putch(c * CHAR_WIDTH, 0, text[c]);
+    }
+  }
+  Serial.print("putch: ");
+  Serial.println((cycles_now() - start) / prints);
+
+  start = cycles_now();
+  for (uint8_t i = 0; i < prints; i++) {
+    drawCells(0, 0, text, length);
+  }
+  Serial.print("blocks: ");
+  Serial.println((cycles_now() - start) / prints);
+
+#if LINE_CACHE
+  start = cycles_now();
+  for (uint8_t i = 0; i < prints; i++) {
+    printCells(0, 0, text, length);
+  }
+  Serial.print("line cache: ");
+  Serial.println((cycles_now() - start) / prints);
+  line_cache.clearStats();
+#endif
+  clearLine(1);
+}
+#endif
+
+// SPI ring through the parsers. Runs again straight away while there is
+// a backlog, the budget only lets the more urgent tasks in between.
+void parseTask()
+{
+  noInterrupts();
+  spiReceived();
+  interrupts();
+
+  if (!input_pending && buffer.available()) {
+    input_pending = true;
+    input_since = cycles_now();
+  }
+
+  if (processInput(processBudget())) {
+    scheduler.release(parse_task);
+  }
+  updateStatus();
+  if (matrix.dirtyRows()) {
+    scheduler.release(render_task);
+  }
+}
+
+void renderTask()
+{
+  uint32_t encoded = matrix.encodedRows();
+  matrix.update();
+
+  bool changed = matrix.encodedRows() != encoded;
+  render_encoded += matrix.encodedRows() - encoded;
+  render_updates += changed;
+  if (input_pending && changed) {
+    recordLatency(cycles_now() - input_since);
+    input_pending = false;
+  } else if (!buffer.available()) {
+    // consumed without drawing anything, e.g. on or off
+    input_pending = false;
+  }
+
+  applyRefresh(changed || buffer.available());
+}
+
+void animateTask()
+{
+  applyScroll();
+  applyPlaylist();
+  if (matrix.dirtyRows()) {
+    scheduler.release(render_task);
+  }
+}
+
+#if STATS_REPORT_MS
+void statsTask()
+{
+  reportLatency();
+  reportStats();
+}
+#endif
+
+// the tasks are released by Timer2, which loop() sleeps between
+void initScheduler()
+{
+  parse_task = scheduler.add("parse", parseTask, PARSE_PERIOD, PARSE_DEADLINE, 0);
+  render_task = scheduler.add("render", renderTask, RENDER_PERIOD, RENDER_DEADLINE, 1);
+  scheduler.add("animate", animateTask, ANIMATE_PERIOD, ANIMATE_DEADLINE, 2);
+#if STATS_REPORT_MS
+  scheduler.add("stats", statsTask, STATS_REPORT_MS * SCHED_HZ / 1000,
+                STATS_REPORT_MS * SCHED_HZ / 1000, 3);
+#endif
+
+  Timer2.pause();
+  Timer2.setPeriod(1000000 / SCHED_HZ);
+  Timer2.attachInterrupt(TIMER_UPDATE_INTERRUPT, schedulerTick);
+  Timer2.refresh();
+  Timer2.resume();
+}
+
 void setup()
 {
   Serial.begin(9600);
   pinMode(LED_PIN, OUTPUT);
   digitalWrite(LED_PIN, HIGH);
+  cycles_begin();
   initSpi();
-  matrix.begin(displaybuf, WIDTH, HEIGHT);
+#if DOUBLE_BUFFER
+  matrix.begin(frontbuf, displaybuf);
+#if TILE_MAP
+  if (!matrix.setTileMap(tiles, sizeof(tiles) / sizeof(tiles[0]), 64)) {
+    Serial.println("Tile map: too many modules for one chain, keeping full width rows");
+  }
+#endif
   matrix.reverse();
-  buffer.begin(bufferData, BUFF_LEN);
+  matrix.setScanBuffer(scanbuf, backScanbuf, COLOUR_DEPTH);
+#else
+  matrix.begin(displaybuf);
+#if TILE_MAP
+  if (!matrix.setTileMap(tiles, sizeof(tiles) / sizeof(tiles[0]), 64)) {
+    Serial.println("Tile map: too many modules for one chain, keeping full width rows");
+  }
+#endif
+  matrix.reverse();
+  matrix.setScanBuffer(scanbuf, COLOUR_DEPTH);
+#endif
+#if PIXEL_LAYER
+  matrix.setPixelBuffer(pixelbuf);
+#endif
+  initScroll();
+#ifdef NATIVE_HAL
+  panel.setActiveLow(matrix.isReversed());
+#endif
+#if PRINT_BENCHMARK
+  benchmarkPrint();
+#endif
   printLine(2, "        Where's my bus?");
+#if SCAN_BENCHMARK
+  benchmarkScan();
+#endif
+  scanning = engine.begin(&matrix);
+  if (!scanning) {
+    Serial.println("Scan engine: matrix geometry not supported, display off");
+  }
+  commitDisplay();
+  matrix.update();
+  engine.start();
+  initScheduler();
+  reportMemory();
 }
 
 void loop()
 {
-  matrix.scan();
-
-  if (command_count > 0) {
-    uint8_t character;
-    if (buffer.get(&character)) {
-      process_character(character);
-    }
+  while (scheduler.runNext()) {
   }
+  waitForInterrupt();
 }
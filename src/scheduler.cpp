@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2017 David McKelvie.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "scheduler.h"
+
+Scheduler::Scheduler()
+{
+  memset(tasks, 0, sizeof(tasks));
+  taskCount = 0;
+  ticks = 0;
+}
+
+int8_t Scheduler::add(const char *name, task_fn_t run, uint16_t period, uint16_t deadline,
+                      uint8_t priority)
+{
+  if (taskCount == SCHED_TASKS) return -1;
+
+  task_t *t = &tasks[taskCount];
+  t->name = name;
+  t->run = run;
+  t->period = period;
+  t->deadline = deadline;
+  t->priority = priority;
+  t->released = false;
+  t->next = ticks;
+  return taskCount++;
+}
+
+void Scheduler::release(int8_t id)
+{
+  if (id < 0 || id >= taskCount) return;
+
+  task_t *t = &tasks[id];
+  if (!t->released) {
+    t->released = true;
+    t->release = ticks;
+  }
+}
+
+bool Scheduler::runNext()
+{
+  uint32_t time = ticks;
+  task_t *best = 0;
+
+  for (uint8_t i = 0; i < taskCount; i++) {
+    task_t *t = &tasks[i];
+
+    if (t->period) {
+      while ((int32_t) (time - t->next) >= 0) {
+        if (!t->released) {
+          t->released = true;
+          t->release = t->next;
+        } else if ((int32_t) (t->next - t->release) > t->deadline) {
+          // still waiting, a period missed
+          t->overruns++;
+        }
+        t->next += t->period;
+      }
+    }
+
+    if (!t->released) continue;
+    if (!best || t->priority < best->priority ||
+        (t->priority == best->priority &&
+         (int32_t) (t->release + t->deadline - best->release - best->deadline) < 0)) {
+      best = t;
+    }
+  }
+
+  if (!best) return false;
+
+  // the task may release itself again while it runs
+  uint32_t released_at = best->release;
+  best->released = false;
+  best->run();
+
+  uint32_t response = ticks - released_at;
+  best->runs++;
+  if (response > best->deadline) {
+    best->overruns++;
+  }
+  if (response > best->worst) {
+    best->worst = response;
+  }
+  return true;
+}
+
+void Scheduler::clearStats()
+{
+  for (uint8_t i = 0; i < taskCount; i++) {
+    tasks[i].runs = 0;
+    tasks[i].overruns = 0;
+    tasks[i].worst = 0;
+  }
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2017 David McKelvie.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SCHEDULER_H__
+#define __SCHEDULER_H__
+#include <stdint.h>
+
+#define SCHED_TASKS     8       // most tasks a Scheduler holds
+
+typedef void (*task_fn_t)();
+
+typedef struct {
+  const char *name;
+  task_fn_t run;
+  uint16_t period;      // ticks between releases, 0 only runs when released
+  uint16_t deadline;    // ticks from release to finishing
+  uint8_t priority;     // 0 first, earliest deadline first among equals
+  bool released;        // waiting to run
+  uint32_t release;     // tick it was released at
+  uint32_t next;        // tick of the next periodic release
+  uint32_t runs;
+  uint32_t overruns;    // deadlines missed
+  uint32_t worst;       // longest release to finish, ticks
+} task_t;
+
+//////////////////////////////////////////////////////////
+///
+///\brief   run to completion tasks released by a timer tick
+///
+/// tick() is all the timebase interrupt does. runNext() is called from
+/// loop(): it releases whatever is due, then runs the released task with
+/// the lowest priority number to completion, nothing is preempted.
+/// Releasing a task that is already waiting does nothing. A task that
+/// finishes more than its deadline after its release counts an overrun,
+/// and one more for each period it was still waiting past the deadline.
+/// Times are whole ticks, so a finish within the tick after the deadline
+/// is not counted.
+///
+//////////////////////////////////////////////////////////
+class Scheduler {
+public:
+  Scheduler();
+
+  //////////////////////////////////////////////////////////
+  ///
+  ///\brief   add a task, first released on the next runNext()
+  ///
+  ///\return  task id, -1 if there are SCHED_TASKS already
+  ///
+  //////////////////////////////////////////////////////////
+  int8_t add(const char *name, task_fn_t run, uint16_t period, uint16_t deadline,
+             uint8_t priority);
+
+  // from the timebase interrupt
+  void tick() { ticks++; }
+  uint32_t now() { return ticks; }
+
+  // run as soon as priority allows, e.g. when there is more work
+  void release(int8_t id);
+
+  //////////////////////////////////////////////////////////
+  ///
+  ///\brief   run the most urgent released task
+  ///
+  ///\return  false if nothing was released, time to sleep
+  ///
+  //////////////////////////////////////////////////////////
+  bool runNext();
+
+  uint8_t count() { return taskCount; }
+  const task_t *task(uint8_t id) { return &tasks[id]; }
+  // runs, overruns and worst start again from zero
+  void clearStats();
+
+private:
+  task_t tasks[SCHED_TASKS];
+  uint8_t taskCount;
+  volatile uint32_t ticks;
+};
+
+#endif /* __SCHEDULER_H__ */
@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2017 David McKelvie.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Bytes on the wire and decode time for CMD_DELTA against raw uploads, on
+// bus stop boards changing the way they do in service. Runs on the host:
+//
+//   g++ -O2 -Isrc -Ilib/LEDMatrix tools/delta_bench.cpp src/delta.cpp -o delta_bench
+//
+// Decode times are host nanoseconds, for target cycles send CMD_STATS to a
+// -D PROFILE=1 build and read the "decode" line.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include "delta.h"
+#include "frame.h"
+
+typedef uint8_t byte;
+#include "font.h"
+
+#define WIDTH       192
+#define HEIGHT      32
+#define STRIDE      (WIDTH / 8)
+#define CHAR_WIDTH  6
+#define CHAR_HEIGHT 8
+#define FRAME_BYTES (STRIDE * HEIGHT)
+#define ITERATIONS  20000
+
+typedef struct {
+  const char *name;
+  const char *before[4];
+  const char *after[4];
+} scenario_t;
+
+static const scenario_t scenarios[] = {
+  { "countdown",
+    { "12  City Centre     3 min", "7A  Airport         8 min", "25  Hospital       14 min", "12:04         Stop 5" },
+    { "12  City Centre     2 min", "7A  Airport         7 min", "25  Hospital       13 min", "12:04         Stop 5" } },
+  { "clock",
+    { "12  City Centre     3 min", "7A  Airport         8 min", "25  Hospital       14 min", "12:04         Stop 5" },
+    { "12  City Centre     3 min", "7A  Airport         8 min", "25  Hospital       14 min", "12:05         Stop 5" } },
+  { "departure",
+    { "12  City Centre     1 min", "7A  Airport         8 min", "25  Hospital       14 min", "12:04         Stop 5" },
+    { "7A  Airport         7 min", "25  Hospital       13 min", "12  City Centre    19 min", "12:05         Stop 5" } },
+  { "new page",
+    { "12  City Centre     3 min", "7A  Airport         8 min", "25  Hospital       14 min", "12:04         Stop 5" },
+    { "  Service change from", "   Monday 3 June:", " route 25 runs every", "    15 minutes" } },
+};
+
+static void render(const char *const lines[4], uint8_t *frame)
+{
+  memset(frame, 0, FRAME_BYTES);
+  for (int line = 0; line < 4; line++) {
+    const char *text = lines[line];
+    for (int i = 0; text[i] && (i + 1) * CHAR_WIDTH <= WIDTH; i++) {
+      uint8_t c = text[i];
+      const uint8_t *glyph = ASCII[(c < 0x20 || c > 0x7E ? ' ' : c) - 0x20];
+      for (int row = 0; row < CHAR_HEIGHT; row++) {
+        for (int bit = 0; bit < CHAR_WIDTH; bit++) {
+          if (glyph[row] & (0x80 >> bit)) {
+            int x = i * CHAR_WIDTH + bit;
+            frame[(line * CHAR_HEIGHT + row) * STRIDE + x / 8] |= 0x80 >> (x % 8);
+          }
+        }
+      }
+    }
+  }
+}
+
+// bytes of the region, row by row
+static void region(const uint8_t *frame, int x, int y, int width, int height, uint8_t *out)
+{
+  for (int row = 0; row < height; row++) {
+    memcpy(out + row * width, frame + (y + row) * STRIDE + x, width);
+  }
+}
+
+// smallest byte aligned box holding every changed byte, false if none
+static bool changed(const uint8_t *a, const uint8_t *b, int *x, int *y, int *width, int *height)
+{
+  int left = STRIDE, right = -1, top = HEIGHT, bottom = -1;
+  for (int row = 0; row < HEIGHT; row++) {
+    for (int column = 0; column < STRIDE; column++) {
+      if (a[row * STRIDE + column] != b[row * STRIDE + column]) {
+        left = column < left ? column : left;
+        right = column > right ? column : right;
+        top = row < top ? row : top;
+        bottom = row > bottom ? row : bottom;
+      }
+    }
+  }
+  *x = left;
+  *y = top;
+  *width = right - left + 1;
+  *height = bottom - top + 1;
+  return right >= 0;
+}
+
+static double decodeNs(uint8_t flags, const uint8_t *runs, uint32_t length, int width, int height, uint8_t *frame)
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (int i = 0; i < ITERATIONS; i++) {
+    delta_decode(frame, STRIDE, width, flags, runs, length);
+  }
+  std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count() / ITERATIONS;
+}
+
+static double copyNs(const uint8_t *image, uint8_t *frame)
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (int i = 0; i < ITERATIONS; i++) {
+    memcpy(frame, image, FRAME_BYTES);
+    __asm__ __volatile__("" : : "r"(frame) : "memory");
+  }
+  std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count() / ITERATIONS;
+}
+
+int main()
+{
+  static uint8_t before[FRAME_BYTES], after[FRAME_BYTES], scratch[FRAME_BYTES];
+  static uint8_t runs[FRAME_BYTES * 2], a[FRAME_BYTES], b[FRAME_BYTES];
+  const uint32_t raw = FRAME_OVERHEAD + FRAME_BYTES;
+
+  printf("%-10s %10s %10s %10s %10s %12s %12s\n", "", "raw", "rle", "xor", "xor box", "copy ns", "xor box ns");
+  for (size_t s = 0; s < sizeof(scenarios) / sizeof(scenarios[0]); s++) {
+    const scenario_t *scenario = &scenarios[s];
+    render(scenario->before, before);
+    render(scenario->after, after);
+
+    uint32_t rle = delta_encode(0, after, FRAME_BYTES, runs, sizeof(runs));
+    uint32_t xor_all = delta_encode(before, after, FRAME_BYTES, runs, sizeof(runs));
+
+    int x, y, width, height;
+    uint32_t box = 0;
+    double boxNs = 0;
+    if (changed(before, after, &x, &y, &width, &height)) {
+      region(before, x, y, width, height, a);
+      region(after, x, y, width, height, b);
+      box = delta_encode(a, b, width * height, runs, sizeof(runs));
+
+      // the decoded box has to reproduce the new frame
+      memcpy(scratch, before, FRAME_BYTES);
+      delta_decode(scratch + y * STRIDE + x, STRIDE, width, DELTA_XOR, runs, box);
+      if (memcmp(scratch, after, FRAME_BYTES)) {
+        printf("%s: decode mismatch\n", scenario->name);
+        return 1;
+      }
+      boxNs = decodeNs(DELTA_XOR, runs, box, width, height, scratch);
+    }
+
+    printf("%-10s %10u %10u %10u %10u %12.0f %12.0f\n", scenario->name, raw,
+           FRAME_OVERHEAD + DELTA_HEADER + rle, FRAME_OVERHEAD + DELTA_HEADER + xor_all,
+           box ? FRAME_OVERHEAD + DELTA_HEADER + box : 0, copyNs(after, scratch), boxNs);
+  }
+  return 0;
+}
@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) 2017 David McKelvie.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// The byte-at-a-time drawImage(), drawRect() and clear() against the same
+// drawing done a drawPoint() at a time, on random placements that include
+// every bit offset and clipping at the canvas edges, then how long each
+// takes on the host. Exits non-zero if any result differs:
+//
+//   g++ -O2 -DNATIVE_HAL -DNATIVE_NO_MAIN -Ilib/NativeHal -Ilib/LEDMatrix lib/LEDMatrix/*.cpp lib/NativeHal/*.cpp tools/draw_test.cpp -o draw_test
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <Arduino.h>
+#include "LEDMatrix.h"
+#include "NativeHal.h"
+
+// as in src/main.cpp
+#define CANVAS_WIDTH    384
+#define HEIGHT          32
+#define CANVAS_BYTES    (CANVAS_WIDTH * HEIGHT / 8)
+#define MAX_IMAGE       (CANVAS_BYTES + HEIGHT)    // widest image with a byte of padding a row
+#define RUNS            20000
+#define BENCH_RUNS      2000
+
+static uint8_t fastbuf[CANVAS_BYTES];
+static uint8_t slowbuf[CANVAS_BYTES];
+static uint8_t image[MAX_IMAGE];
+
+static LEDMatrix fast(PA13, PA12, PA11, PA8, PB0, PB9, PB5, PB14, PB15);
+static LEDMatrix slow(PA13, PA12, PA11, PA8, PB0, PB9, PB5, PB14, PB15);
+
+// native_pass() calls loop(), there is no firmware here
+void setup()
+{
+}
+
+void loop()
+{
+}
+
+// the per-pixel versions, what the fast paths must match
+static void pointImage(LEDMatrix &matrix, uint16_t xoffset, uint16_t yoffset, uint16_t width,
+                       uint16_t height, const uint8_t *image)
+{
+  uint16_t stride = (width + 7) / 8;
+  for (uint16_t y = 0; y < height && yoffset + y < HEIGHT; y++) {
+    for (uint16_t x = 0; x < width && xoffset + x < CANVAS_WIDTH; x++) {
+      matrix.drawPoint(xoffset + x, yoffset + y, image[y * stride + x / 8] & (0x80 >> (x % 8)));
+    }
+  }
+}
+
+static void pointRect(LEDMatrix &matrix, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, uint8_t pixel)
+{
+  for (uint16_t y = y1; y < y2 && y < HEIGHT; y++) {
+    for (uint16_t x = x1; x < x2 && x < CANVAS_WIDTH; x++) {
+      matrix.drawPoint(x, y, pixel);
+    }
+  }
+}
+
+static void pointClear(LEDMatrix &matrix)
+{
+  pointRect(matrix, 0, 0, CANVAS_WIDTH, HEIGHT, 0);
+}
+
+static void randomise(uint8_t *bytes, uint32_t length)
+{
+  for (uint32_t i = 0; i < length; i++) {
+    bytes[i] = rand();
+  }
+}
+
+// a placement that is usually on the canvas and sometimes runs off it
+static uint16_t coordinate(uint16_t limit)
+{
+  return rand() % (limit + limit / 4);
+}
+
+static bool same(const char *what, uint32_t run)
+{
+  if (memcmp(fastbuf, slowbuf, CANVAS_BYTES) == 0) {
+    return true;
+  }
+  printf("%s differs from drawPoint() on run %u\n", what, run);
+  return false;
+}
+
+static bool test()
+{
+  randomise(fastbuf, CANVAS_BYTES);
+  memcpy(slowbuf, fastbuf, CANVAS_BYTES);
+
+  for (uint32_t run = 0; run < RUNS; run++) {
+    uint16_t x = coordinate(CANVAS_WIDTH);
+    uint16_t y = coordinate(HEIGHT);
+    uint16_t width = 1 + rand() % (rand() & 1 ? 24 : CANVAS_WIDTH);
+    uint16_t height = 1 + rand() % HEIGHT;
+
+    switch (rand() % 8) {
+      case 0:
+      case 1:
+      case 2:
+        randomise(image, (width + 7) / 8 * height);
+        fast.drawImage(x, y, width, height, image);
+        pointImage(slow, x, y, width, height, image);
+        if (!same("drawImage()", run)) {
+          printf("  at %u, %u size %u x %u\n", x, y, width, height);
+          return false;
+        }
+        break;
+
+      case 3:
+      case 4:
+      case 5:
+      case 6: {
+        uint8_t pixel = rand() & 1;
+        fast.drawRect(x, y, x + width, y + height, pixel);
+        pointRect(slow, x, y, x + width, y + height, pixel);
+        if (!same("drawRect()", run)) {
+          printf("  %u, %u to %u, %u pixel %u\n", x, y, x + width, y + height, pixel);
+          return false;
+        }
+        break;
+      }
+
+      default:
+        fast.clear();
+        pointClear(slow);
+        if (!same("clear()", run)) {
+          return false;
+        }
+        randomise(fastbuf, CANVAS_BYTES);
+        memcpy(slowbuf, fastbuf, CANVAS_BYTES);
+        break;
+    }
+  }
+  printf("%u random draws match drawPoint()\n", RUNS);
+  return true;
+}
+
+template <typename Draw>
+static double nanoseconds(Draw draw)
+{
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t run = 0; run < BENCH_RUNS; run++) {
+    draw();
+  }
+  std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count() / BENCH_RUNS;
+}
+
+static void bench(const char *what, double fastNs, double slowNs)
+{
+  printf("%-30s %9.0f %9.0f %6.1fx\n", what, fastNs, slowNs, slowNs / fastNs);
+}
+
+static void benchmark()
+{
+  randomise(image, MAX_IMAGE);
+
+  printf("\n%-30s %9s %9s %7s\n", "ns per call on the host", "fast", "drawPoint", "");
+  bench("drawImage 192x32 aligned",
+        nanoseconds([] { fast.drawImage(0, 0, 192, HEIGHT, image); }),
+        nanoseconds([] { pointImage(slow, 0, 0, 192, HEIGHT, image); }));
+  bench("drawImage 192x32 at x 3",
+        nanoseconds([] { fast.drawImage(3, 0, 192, HEIGHT, image); }),
+        nanoseconds([] { pointImage(slow, 3, 0, 192, HEIGHT, image); }));
+  bench("drawImage 5x7 glyph at x 13",
+        nanoseconds([] { fast.drawImage(13, 8, 5, 7, image); }),
+        nanoseconds([] { pointImage(slow, 13, 8, 5, 7, image); }));
+  bench("drawRect 190x8 at x 1",
+        nanoseconds([] { fast.drawRect(1, 8, 191, 16, 1); }),
+        nanoseconds([] { pointRect(slow, 1, 8, 191, 16, 1); }));
+  bench("clear 384x32",
+        nanoseconds([] { fast.clear(); }),
+        nanoseconds([] { pointClear(slow); }));
+}
+
+int main()
+{
+  fast.begin(fastbuf, 192, HEIGHT);
+  fast.setCanvas(CANVAS_WIDTH, HEIGHT);
+  slow.begin(slowbuf, 192, HEIGHT);
+  slow.setCanvas(CANVAS_WIDTH, HEIGHT);
+
+  if (!test()) {
+    return 1;
+  }
+  benchmark();
+  return 0;
+}
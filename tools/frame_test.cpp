@@ -0,0 +1,262 @@
+/*
+ * Copyright (C) 2017 David McKelvie.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Damaged v2 frames against the native build of the firmware. Frames with
+// a bad CRC, an over long length and a tail that never arrives must report
+// their frame_result_t on MISO, draw nothing, and leave the parser to find
+// the next SOH, ignoring v1 commands until it does. Then v1 commands and v2
+// frames are interleaved, each drawing a rectangle on the simulated panel:
+//
+//   g++ -O2 -DNATIVE_HAL -DNATIVE_NO_MAIN -Ilib/NativeHal -Ilib/LEDMatrix -Isrc
+//       src/*.cpp lib/LEDMatrix/*.cpp lib/NativeHal/*.cpp tools/frame_test.cpp -o frame_test
+//
+// Exits non-zero if any check fails.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <Arduino.h>
+#include <NativeHal.h>
+#include <Panel.h>
+#include "frame.h"
+
+#define STX             2       // as in src/main.cpp
+#define ETX             3
+#define CMD_CLEAR_DISP  6
+#define CMD_FILL_RECT   18
+#define FRAME_WAIT_MS   100
+#define FRAME_PAYLOAD_MAX (8 + 192 * 32 / 8)
+#define PASSES          8       // of loop(), enough to parse and draw a frame
+
+void setup();
+extern Panel panel;
+
+static int failures = 0;
+
+static void check(bool ok, const char *what)
+{
+  printf("%-48s %s\n", what, ok ? "ok" : "FAILED");
+  failures += !ok;
+}
+
+static void send(const uint8_t *data, uint16_t length)
+{
+  native_spi_receive(data, length, 0);
+}
+
+static void settle()
+{
+  for (int i = 0; i < PASSES; i++) {
+    native_pass();
+  }
+}
+
+// the result of the last frame, polling with NULs the parser ignores. The
+// first reply was loaded before the passes, the second is current.
+static uint8_t result()
+{
+  uint8_t poll[2] = {0, 0};
+  uint8_t reply[2];
+
+  settle();
+  native_spi_receive(poll, sizeof(poll), reply);
+  return (reply[1] & STATUS_RESULT_MASK) >> STATUS_RESULT_SHIFT;
+}
+
+// a v2 frame into out, returns its length
+static uint16_t frame(uint8_t command, const uint8_t *payload, uint16_t length, uint8_t *out)
+{
+  out[0] = SOH;
+  out[1] = (uint8_t) length;
+  out[2] = length >> 8;
+  out[3] = command;
+  memcpy(out + 4, payload, length);
+  uint16_t crc = crc16(out + 1, length + 3);
+  out[4 + length] = (uint8_t) crc;
+  out[5 + length] = crc >> 8;
+  return length + FRAME_OVERHEAD;
+}
+
+// CMD_FILL_RECT's payload, also the v1 parameter and data after STX, command
+static void rect(uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint8_t *out)
+{
+  const uint8_t payload[7] = {0xff, x, 0, y, width, 0, height};
+  memcpy(out, payload, sizeof(payload));
+}
+
+static uint16_t v2Rect(uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint8_t *out)
+{
+  uint8_t payload[7];
+  rect(x, y, width, height, payload);
+  return frame(CMD_FILL_RECT, payload, sizeof(payload), out);
+}
+
+static uint16_t v1Rect(uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint8_t *out)
+{
+  out[0] = STX;
+  out[1] = CMD_FILL_RECT;
+  rect(x, y, width, height, out + 2);
+  out[9] = ETX;
+  return 10;
+}
+
+static void clearDisplay()
+{
+  const uint8_t clear[] = {STX, CMD_CLEAR_DISP};
+  send(clear, sizeof(clear));
+  settle();
+}
+
+// panel pixels lit in a rectangle
+static uint32_t lit(uint8_t x, uint8_t y, uint8_t width, uint8_t height)
+{
+  uint32_t count = 0;
+  for (uint8_t row = y; row < y + height; row++) {
+    for (uint8_t column = x; column < x + width; column++) {
+      count += panel.pixel(column, row) != 0;
+    }
+  }
+  return count;
+}
+
+static bool filled(uint8_t x, uint8_t y, uint8_t width, uint8_t height)
+{
+  return lit(x, y, width, height) == (uint32_t) width * height;
+}
+
+static bool dark(uint8_t x, uint8_t y, uint8_t width, uint8_t height)
+{
+  return lit(x, y, width, height) == 0;
+}
+
+static void testGood()
+{
+  uint8_t bytes[32];
+
+  check(result() == FRAME_NONE, "no frame yet");
+  send(bytes, v2Rect(8, 2, 16, 4, bytes));
+  check(result() == FRAME_ACK && filled(8, 2, 16, 4), "good frame: ack, drawn");
+
+  // valid CRC, a payload a byte short for the command
+  uint8_t payload[7];
+  rect(40, 2, 16, 4, payload);
+  send(bytes, frame(CMD_FILL_RECT, payload, 6, bytes));
+  check(result() == FRAME_NAK && dark(40, 2, 16, 4), "short payload: nak, not drawn");
+}
+
+static void testCrc()
+{
+  uint8_t bytes[64];
+  uint16_t length;
+
+  // damaged in the payload, the frame after it in the same transfer
+  length = v2Rect(8, 10, 16, 4, bytes);
+  bytes[6] ^= 0x40;
+  length += v2Rect(40, 10, 16, 4, bytes + length);
+  send(bytes, length);
+  settle();
+  check(dark(8, 10, 16, 4), "bad crc: not drawn");
+  check(filled(40, 10, 16, 4), "bad crc: frame straight after it applied");
+
+  // on its own, the result is the CRC error
+  length = v2Rect(72, 10, 16, 4, bytes);
+  bytes[length - 1] ^= 0x01;
+  send(bytes, length);
+  check(result() == FRAME_CRC_ERROR && dark(72, 10, 16, 4), "bad crc: crc error reported");
+
+  send(bytes, v2Rect(104, 10, 16, 4, bytes));
+  check(result() == FRAME_ACK && filled(104, 10, 16, 4), "bad crc: next frame acked");
+}
+
+static void testTooLong()
+{
+  uint8_t bytes[64];
+  uint16_t length;
+  const uint8_t header[] = {SOH, (FRAME_PAYLOAD_MAX + 1) & 0xff, (FRAME_PAYLOAD_MAX + 1) >> 8, CMD_FILL_RECT};
+
+  memcpy(bytes, header, sizeof(header));
+  length = sizeof(header);
+  send(bytes, length);
+  check(result() == FRAME_TOO_LONG, "too long: reported");
+
+  // a v1 command before the next SOH is the rest of the bad frame
+  length = v1Rect(8, 18, 16, 4, bytes);
+  length += v2Rect(40, 18, 16, 4, bytes + length);
+  send(bytes, length);
+  check(result() == FRAME_ACK && filled(40, 18, 16, 4), "too long: next frame acked");
+  check(dark(8, 18, 16, 4), "too long: v1 before the next SOH dropped");
+}
+
+static void testTimeout()
+{
+  uint8_t bytes[32];
+  uint16_t length = v2Rect(8, 26, 16, 4, bytes);
+
+  // the header and part of the payload, none of it SOH
+  send(bytes, length - 4);
+  check(result() == FRAME_ACK && dark(8, 26, 16, 4), "truncated: waits for the rest");
+  uint32_t start = millis();
+  while (millis() - start <= FRAME_WAIT_MS + 20) {
+    native_pass();
+  }
+  check(result() == FRAME_TIMEOUT && dark(8, 26, 16, 4), "truncated: timeout after FRAME_WAIT_MS");
+
+  send(bytes, v2Rect(40, 26, 16, 4, bytes));
+  check(result() == FRAME_ACK && filled(40, 26, 16, 4), "truncated: next frame acked");
+}
+
+static void testInterleaved()
+{
+  uint8_t bytes[96];
+  uint16_t length = 0;
+
+  clearDisplay();
+
+  // v1 and v2 back to back, x 1 puts an SOH inside the v1 data
+  length += v1Rect(1, 2, 16, 4, bytes + length);
+  length += v2Rect(40, 2, 16, 4, bytes + length);
+  length += v1Rect(72, 2, 16, 4, bytes + length);
+  length += v2Rect(104, 2, 16, 4, bytes + length);
+  send(bytes, length);
+  check(result() == FRAME_ACK, "interleaved: last frame acked");
+  check(filled(1, 2, 16, 4) && filled(72, 2, 16, 4), "interleaved: v1 commands drawn");
+  check(filled(40, 2, 16, 4) && filled(104, 2, 16, 4), "interleaved: v2 frames drawn");
+
+  // split across passes, mid v1 command and mid frame
+  length = v1Rect(1, 10, 16, 4, bytes);
+  length += v2Rect(40, 10, 16, 4, bytes + length);
+  for (uint16_t i = 0; i < length; i += 3) {
+    send(bytes + i, length - i < 3 ? length - i : 3);
+    native_pass();
+  }
+  check(result() == FRAME_ACK && filled(1, 10, 16, 4) && filled(40, 10, 16, 4), "interleaved: split across passes");
+}
+
+int main()
+{
+  setup();
+  native_pass();
+  clearDisplay();
+
+  testGood();
+  testCrc();
+  testTooLong();
+  testTimeout();
+  testInterleaved();
+
+  printf("%d failed\n", failures);
+  return failures ? 1 : 0;
+}
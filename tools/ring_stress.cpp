@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2017 David McKelvie.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// CircularBuffer with a producer and a consumer thread, as the SPI
+// interrupt and loop() use it. The producer writes a numbered byte stream
+// in random sized pieces, waiting for space, and the consumer takes it with
+// every read call in turn and checks nothing is lost, repeated or torn.
+// Then the same transfer is timed a byte and a block at a time. Runs on
+// the host, exits non-zero on the first bad byte:
+//
+//   g++ -O2 -pthread -Isrc tools/ring_stress.cpp -o ring_stress
+//
+// Build with -fsanitize=thread as well to have the ordering checked.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+#include "buffer.h"
+
+#define STRESS_BYTES    (64UL << 20)
+#define BENCH_BYTES     (256UL << 20)
+#define MAX_PIECE       300
+
+static inline uint8_t expected(uint32_t n)
+{
+  return (uint8_t) (n ^ (n >> 8) ^ (n >> 16));
+}
+
+// simple per-thread generator, rand() is not thread safe
+static inline uint32_t next(uint32_t *seed)
+{
+  *seed = *seed * 1103515245 + 12345;
+  return *seed >> 16;
+}
+
+template <typename Ring>
+static void produce(Ring *ring, uint32_t total)
+{
+  uint8_t piece[MAX_PIECE];
+  uint32_t seed = 1;
+  uint32_t n = 0;
+
+  while (n < total) {
+    uint32_t count = 1 + next(&seed) % MAX_PIECE;
+    if (count > total - n) {
+      count = total - n;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+      piece[i] = expected(n + i);
+    }
+
+    uint32_t done = 0;
+    while (done < count) {
+      uint32_t room = ring->space();
+      if (!room) {
+        std::this_thread::yield();
+        continue;
+      }
+      uint32_t chunk = count - done < room ? count - done : room;
+      if (chunk == 1 && next(&seed) & 1) {
+        ring->put(piece[done]);
+      } else {
+        ring->write(piece + done, chunk);
+      }
+      done += chunk;
+    }
+    n += count;
+  }
+}
+
+// take the stream with get(), read(), peek() then skip() and contiguous()
+// in turn, false at the first byte out of place
+template <typename Ring>
+static bool consume(Ring *ring, uint32_t total)
+{
+  uint8_t piece[MAX_PIECE];
+  uint32_t seed = 2;
+  uint32_t n = 0;
+
+  while (n < total) {
+    if (!ring->available()) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    uint32_t want = 1 + next(&seed) % MAX_PIECE;
+    uint32_t got = 0;
+    const uint8_t *span = piece;
+
+    switch (next(&seed) % 4) {
+      case 0:
+        got = ring->get(piece);
+        break;
+      case 1:
+        got = ring->read(piece, want);
+        break;
+      case 2:
+        got = ring->peek(piece, want);
+        ring->skip(got);
+        break;
+      default:
+        got = ring->contiguous(&span);
+        if (got > want) {
+          got = want;
+        }
+        for (uint32_t i = 0; i < got; i++) {
+          piece[i] = span[i];
+        }
+        ring->skip(got);
+        break;
+    }
+
+    for (uint32_t i = 0; i < got; i++) {
+      if (piece[i] != expected(n + i)) {
+        printf("byte %u is %02x, expected %02x\n", n + i, piece[i], expected(n + i));
+        return false;
+      }
+    }
+    n += got;
+  }
+  return true;
+}
+
+template <typename Ring>
+static bool stress(const char *what, uint32_t total)
+{
+  static Ring ring;
+  bool ok = false;
+
+  std::thread producer(produce<Ring>, &ring, total);
+  std::thread consumer([&ok, total] { ok = consume(&ring, total); });
+  producer.join();
+  consumer.join();
+
+  ok = ok && ring.overflows() == 0 && ring.available() == 0;
+  printf("%-40s %u bytes %s\n", what, total, ok ? "ok" : "FAILED");
+  return ok;
+}
+
+// bytes per second through the ring between two threads
+template <typename Ring>
+static double throughput(uint32_t piece)
+{
+  static Ring ring;
+  uint8_t *block = new uint8_t[piece];
+  for (uint32_t i = 0; i < piece; i++) {
+    block[i] = i;
+  }
+  auto start = std::chrono::steady_clock::now();
+
+  std::thread producer([block, piece] {
+    for (uint32_t n = 0; n < BENCH_BYTES;) {
+      uint32_t room = ring.space();
+      if (!room) {
+        std::this_thread::yield();
+        continue;
+      }
+      if (piece == 1) {
+        ring.put(block[0]);
+        n++;
+      } else {
+        n += ring.write(block, piece < room ? piece : room);
+      }
+    }
+  });
+  std::thread consumer([piece] {
+    uint8_t sink[MAX_PIECE * 16];
+    for (uint32_t n = 0; n < BENCH_BYTES;) {
+      uint32_t got = piece == 1 ? ring.get(sink) : ring.read(sink, piece);
+      if (!got) {
+        std::this_thread::yield();
+      }
+      n += got;
+    }
+  });
+  producer.join();
+  consumer.join();
+
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  delete[] block;
+  return BENCH_BYTES / elapsed.count();
+}
+
+int main()
+{
+  bool ok = true;
+
+  ok = stress<CircularBuffer<uint8_t, 1024> >("1K ring, 16 bit indices", STRESS_BYTES) && ok;
+  ok = stress<CircularBuffer<uint8_t, 256, uint16_t> >("256 byte ring, wrapping quickly", STRESS_BYTES) && ok;
+  ok = stress<CircularBuffer<uint8_t, 128, uint8_t> >("128 byte ring, 8 bit indices", STRESS_BYTES) && ok;
+  ok = stress<CircularBuffer<uint8_t, 65536, uint32_t> >("64K ring, 32 bit indices", STRESS_BYTES) && ok;
+  if (!ok) {
+    return 1;
+  }
+
+  static const uint32_t pieces[] = { 1, 16, 64, 256, 1024 };
+  printf("\n1K ring between two threads, MB/s by piece size\n");
+  for (uint32_t i = 0; i < sizeof(pieces) / sizeof(pieces[0]); i++) {
+    printf("%6u %10.1f\n", pieces[i], throughput<CircularBuffer<uint8_t, 1024> >(pieces[i]) / 1e6);
+  }
+  return 0;
+}
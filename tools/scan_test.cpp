@@ -0,0 +1,257 @@
+/*
+ * Copyright (C) 2017 David McKelvie.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// ScanEngine against the simulated Panel in lib/NativeHal: the image, the
+// latches, clocks and timer ticks a frame takes at each colour depth, how
+// long OE is low at every brightness level, and the geometries begin() has
+// to refuse. Runs on the host, exits non-zero
+// on the first failure:
+//
+//   g++ -O2 -DNATIVE_HAL -DNATIVE_NO_MAIN -Ilib/NativeHal -Ilib/LEDMatrix lib/LEDMatrix/*.cpp lib/NativeHal/*.cpp tools/scan_test.cpp -o scan_test
+
+#include <math.h>
+#include <stdio.h>
+#include <HardwareTimer.h>
+#include "LEDMatrix.h"
+#include "NativeHal.h"
+#include "Panel.h"
+#include "ScanEngine.h"
+
+// as wired in src/main.cpp
+#define PIN_A           PA13
+#define PIN_B           PA12
+#define PIN_C           PA11
+#define PIN_D           PA8
+#define PIN_OE          PB0
+#define PIN_LAT         PB14
+#define PIN_CLK         PB15
+#define PIN_R1          PB9
+#define PIN_R2          PB5
+
+#define WIDTH           64
+#define HEIGHT          32
+#define ROWS            (HEIGHT / 2)
+#define TICKS           12
+#define MAX_DEPTH       3
+#define FRAMES          3
+#define BLANK_ROW       5           // nothing lit here in either half
+#define MAX_TICKS       1000000     // TIM1 updates before giving up on a frame
+#define OE_MIN_TICKS    8           // shortest OE pulse
+#define SLOWDOWN        40          // long enough rows for the oe timer to prescale
+
+static uint8_t displaybuf[WIDTH * HEIGHT / 8];
+static uint16_t scanbuf[MAX_DEPTH * ROWS * WIDTH];
+
+static LEDMatrix matrix(PIN_A, PIN_B, PIN_C, PIN_D, PIN_OE, PIN_R1, PIN_R2, PIN_LAT, PIN_CLK);
+static ScanEngine engine(Timer1, Timer3);
+static Panel panel(PIN_A, PIN_B, PIN_C, PIN_D, PIN_OE, PIN_LAT, PIN_CLK,
+                   PIN_R1, PIN_R2, PANEL_NO_PIN, PANEL_NO_PIN, PANEL_NO_PIN, PANEL_NO_PIN, WIDTH, ROWS);
+static int failures = 0;
+
+// native_pass() calls loop(), there is no firmware here
+void setup()
+{
+}
+
+void loop()
+{
+}
+
+static void check(bool ok, const char *what)
+{
+  printf("%-48s %s\n", what, ok ? "ok" : "FAILED");
+  failures += !ok;
+}
+
+static bool lit(uint16_t x, uint16_t y)
+{
+  return y % ROWS != BLANK_ROW && ((x * 7 + y * 3) % 5 == 0 || x == y);
+}
+
+// TIM1 until the panel has seen frames more frames
+static bool runFrames(uint32_t frames)
+{
+  uint32_t target = panel.frames() + frames;
+  for (uint32_t tick = 0; tick < MAX_TICKS; tick++) {
+    if (panel.frames() >= target) {
+      return true;
+    }
+    if (!native_timer_tick(1)) {
+      return false;
+    }
+  }
+  return false;
+}
+
+static void testDepth(uint8_t depth)
+{
+  char what[64];
+
+  matrix.setScanBuffer(scanbuf, depth);
+  matrix.clear();
+  for (uint16_t y = 0; y < HEIGHT; y++) {
+    for (uint16_t x = 0; x < WIDTH; x++) {
+      if (lit(x, y)) {
+        matrix.drawPoint(x, y, 1);
+      }
+    }
+  }
+  matrix.update();
+
+  snprintf(what, sizeof(what), "depth %u: begin", depth);
+  check(engine.begin(&matrix, TICKS), what);
+  engine.start();
+
+  // the first frame lines the counters up with row 0's latch
+  bool running = runFrames(1);
+  panel.resetCounters();
+  running = running && runFrames(FRAMES);
+  uint32_t latches = panel.latches();
+  uint32_t clocks = panel.clocks();
+  uint32_t ticks = panel.ticks();
+  uint32_t shown = panel.lit();
+  engine.stop();
+  while (native_timer_tick(1)) {
+  }
+
+  snprintf(what, sizeof(what), "depth %u: %u frames refreshed", depth, FRAMES);
+  check(running, what);
+
+  bool same = true;
+  for (uint16_t y = 0; y < HEIGHT; y++) {
+    for (uint16_t x = 0; x < WIDTH; x++) {
+      same = same && lit(x, y) == (panel.pixel(x, y) != 0);
+    }
+  }
+  snprintf(what, sizeof(what), "depth %u: image", depth);
+  check(same, what);
+
+  // every row latched once a plane, blank rows shifting nothing, and each
+  // plane timed for twice as long as the one before
+  snprintf(what, sizeof(what), "depth %u: latches per frame", depth);
+  check(latches == (uint32_t) FRAMES * ROWS * depth, what);
+  snprintf(what, sizeof(what), "depth %u: clocks per frame", depth);
+  check(clocks == (uint32_t) FRAMES * (ROWS - 1) * depth * WIDTH, what);
+  snprintf(what, sizeof(what), "depth %u: ticks per frame", depth);
+  check(ticks == (uint32_t) FRAMES * TICKS * ((1 << depth) - 1) * WIDTH * ROWS, what);
+  snprintf(what, sizeof(what), "depth %u: refresh rate", depth);
+  check(engine.refreshRate() == F_CPU / (TICKS * ((1UL << depth) - 1) * WIDTH * ROWS), what);
+  snprintf(what, sizeof(what), "depth %u: some of the time lit", depth);
+  check(shown > 0 && shown < ticks, what);
+}
+
+// OE ticks a frame at the given level, slowdown and depth
+static uint32_t litFrame(uint8_t level, uint8_t factor, uint8_t depth)
+{
+  engine.setBrightness(level);
+  engine.setSlowdown(factor);
+  engine.start();
+  runFrames(2);
+  panel.resetCounters();
+  runFrames(1);
+  uint32_t shown = panel.lit();
+  engine.stop();
+  while (native_timer_tick(1)) {
+  }
+  return shown;
+}
+
+static void testBrightness()
+{
+  char what[64];
+
+  matrix.setScanBuffer(scanbuf, 1);
+  check(engine.begin(&matrix, TICKS), "brightness: begin");
+
+  // one OE pulse per lit row, BLANK_ROW stays dark
+  uint32_t rowMax = TICKS * (WIDTH - 1);
+  uint32_t shortest = OE_MIN_TICKS * (ROWS - 1);
+  uint32_t last = 0;
+  bool rising = true;
+  for (uint16_t level = 0; level < 256; level++) {
+    uint32_t shown = litFrame(level, 1, 1);
+    if (level == 0) {
+      check(shown == 0, "brightness: 0 is dark");
+    } else if (shown < last || (shown == last && last != shortest)) {
+      rising = false;
+    }
+    if (level == 1) {
+      check(shown == shortest, "brightness: 1 is the shortest pulse");
+    }
+    if (level == 80 || level == 128) {
+      // on the curve, not a floor above it
+      double curve = pow(level / 255.0, 2.2) * rowMax * (ROWS - 1);
+      snprintf(what, sizeof(what), "brightness: %u on the gamma curve", level);
+      check(fabs(shown - curve) <= ROWS - 1, what);
+    }
+    if (level == 255) {
+      check(shown == rowMax * (ROWS - 1), "brightness: 255 lit for a row less a clock");
+    }
+    last = shown;
+  }
+  check(rising, "brightness: brighter each level past the shortest");
+
+  // slowed down the oe timer prescales, the share lit stays the same
+  matrix.setScanBuffer(scanbuf, MAX_DEPTH);
+  engine.begin(&matrix, TICKS);
+  for (uint8_t level = 16; level; level += 48) {
+    uint64_t full = litFrame(level, 1, MAX_DEPTH);
+    uint64_t slow = litFrame(level, SLOWDOWN, MAX_DEPTH);
+    snprintf(what, sizeof(what), "brightness: %u slowed down %u times", level, SLOWDOWN);
+    check(slow + slow / 100 >= full * SLOWDOWN && slow <= full * SLOWDOWN + full * SLOWDOWN / 100, what);
+  }
+  engine.setBrightness(255);
+  engine.setSlowdown(1);
+}
+
+static void testRefused()
+{
+  static uint8_t wide[288 * HEIGHT / 8];
+  static uint16_t wideScanbuf[288 * ROWS];
+  LEDMatrix other(PIN_A, PIN_B, PIN_C, PIN_D, PIN_OE, PIN_R1, PIN_R2, PIN_LAT, PIN_CLK);
+  LEDMatrix plainOe(PIN_A, PIN_B, PIN_C, PIN_D, PB13, PIN_R1, PIN_R2, PIN_LAT, PIN_CLK);
+  ScanEngine refused(Timer1, Timer3);
+  ScanEngine wrongTimer(Timer1, Timer2);
+
+  other.begin(wide, 288, HEIGHT);
+  check(!refused.begin(&other), "refused: no scan buffer");
+  other.setScanBuffer(wideScanbuf);
+  check(!refused.begin(&other), "refused: 288 columns");
+
+  matrix.setScanBuffer(scanbuf);
+  check(!refused.begin(&matrix, 3), "refused: 3 ticks");
+  check(!wrongTimer.begin(&matrix), "refused: oe not on the oe timer");
+  plainOe.begin(displaybuf, WIDTH, HEIGHT);
+  plainOe.setScanBuffer(scanbuf);
+  check(!refused.begin(&plainOe), "refused: oe on no timer channel");
+  check(refused.refreshRate() == 0, "refused: no refresh rate");
+}
+
+int main()
+{
+  matrix.begin(displaybuf, WIDTH, HEIGHT);
+  matrix.reverse();
+  panel.setActiveLow(matrix.isReversed());
+
+  testRefused();
+  for (uint8_t depth = 1; depth <= MAX_DEPTH; depth++) {
+    testDepth(depth);
+  }
+  testBrightness();
+
+  printf("%d failed\n", failures);
+  return failures ? 1 : 0;
+}
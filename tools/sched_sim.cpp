@@ -0,0 +1,205 @@
+/*
+ * Copyright (C) 2017 David McKelvie.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// The firmware's task set on the real Scheduler, with simulated time and
+// synthetic command load, to see which deadlines go first as the SPI
+// traffic rises. Runs on the host:
+//
+//   g++ -O2 -Isrc tools/sched_sim.cpp src/scheduler.cpp -o sched_sim
+//
+// Task costs are estimates in target microseconds. For real ones send
+// CMD_STATS to a -D PROFILE=1 build and put its cycle counts in below.
+
+#include <stdint.h>
+#include <stdio.h>
+#include "scheduler.h"
+
+// as in src/main.cpp
+#define SCHED_HZ            1000
+#define SCROLL_HZ           100
+#define BUFF_LEN            1024
+#define HEIGHT              32
+#define PROCESS_BUDGET_US   250
+#define PARSE_PERIOD        1
+#define PARSE_DEADLINE      2
+#define RENDER_PERIOD       1
+#define RENDER_DEADLINE     4
+#define ANIMATE_PERIOD      (SCHED_HZ / SCROLL_HZ)
+#define ANIMATE_DEADLINE    ANIMATE_PERIOD
+#define STATS_REPORT_MS     1000
+
+// synthetic load, every command a CMD_PRINT_LINE of a whole text line
+#define COMMAND_BYTES       40
+#define COMMAND_ROWS        8       // rows it dirties
+#define SCROLLING_LINES     1       // lines scrolling, each dirties its rows per scroll tick
+
+// estimated costs
+#define SCAN_LOAD_PCT       8       // CPU the row interrupts take
+#define TASK_US             3       // getting into and out of any task
+#define PARSE_US_PER_BYTE   1
+#define DRAW_US             60      // printLine() of a whole line
+#define ENCODE_US_PER_ROW   20
+#define ANIMATE_US          10
+#define STATS_US            1500    // a report's worth of Serial prints
+
+#define SIM_SECONDS         4
+
+static Scheduler *scheduler;
+static int8_t parse_task;
+static int8_t render_task;
+
+static double now_us;           // simulated time
+static double next_tick_us;
+static double arriving;         // bytes per tick
+static double owed;             // bytes due but not yet arrived
+static uint32_t ring;           // received, not parsed
+static uint32_t partial;        // bytes into the current command
+static uint32_t dirty;          // rows waiting for render
+static uint32_t dropped;        // bytes that arrived to a full ring
+static double busy_us;
+
+// SPI bytes land in the ring between ticks, a blind sender
+static void arrive()
+{
+  owed += arriving;
+  uint32_t bytes = (uint32_t) owed;
+  owed -= bytes;
+  ring += bytes;
+  if (ring > BUFF_LEN) {
+    dropped += ring - BUFF_LEN;
+    ring = BUFF_LEN;
+  }
+}
+
+static void tick()
+{
+  scheduler->tick();
+  arrive();
+  next_tick_us += 1000000.0 / SCHED_HZ;
+}
+
+// run on the CPU for us, less what the row interrupts take
+static void spend(double us)
+{
+  us = us * 100 / (100 - SCAN_LOAD_PCT);
+  busy_us += us;
+  now_us += us;
+  while (now_us >= next_tick_us) {
+    tick();
+  }
+}
+
+static void addDirty(uint32_t rows)
+{
+  dirty = dirty + rows > HEIGHT ? HEIGHT : dirty + rows;
+}
+
+static void parseTask()
+{
+  uint32_t budget = PROCESS_BUDGET_US << (ring * 4 / BUFF_LEN);
+  uint32_t used = 0;
+
+  spend(TASK_US);
+  while (ring && used < budget) {
+    ring--;
+    spend(PARSE_US_PER_BYTE);
+    used += PARSE_US_PER_BYTE;
+    if (++partial == COMMAND_BYTES) {
+      partial = 0;
+      spend(DRAW_US);
+      used += DRAW_US;
+      addDirty(COMMAND_ROWS);
+    }
+  }
+  if (ring) {
+    scheduler->release(parse_task);
+  }
+  if (dirty) {
+    scheduler->release(render_task);
+  }
+}
+
+static void renderTask()
+{
+  spend(TASK_US + dirty * ENCODE_US_PER_ROW);
+  dirty = 0;
+}
+
+static void animateTask()
+{
+  spend(TASK_US + ANIMATE_US);
+  addDirty(SCROLLING_LINES * COMMAND_ROWS);
+  if (dirty) {
+    scheduler->release(render_task);
+  }
+}
+
+static void statsTask()
+{
+  spend(TASK_US + STATS_US);
+}
+
+static void simulate(uint32_t commands, bool stats)
+{
+  Scheduler sched;
+  scheduler = &sched;
+  parse_task = sched.add("parse", parseTask, PARSE_PERIOD, PARSE_DEADLINE, 0);
+  render_task = sched.add("render", renderTask, RENDER_PERIOD, RENDER_DEADLINE, 1);
+  sched.add("animate", animateTask, ANIMATE_PERIOD, ANIMATE_DEADLINE, 2);
+  if (stats) {
+    sched.add("stats", statsTask, STATS_REPORT_MS * SCHED_HZ / 1000,
+              STATS_REPORT_MS * SCHED_HZ / 1000, 3);
+  }
+
+  now_us = 0;
+  next_tick_us = 1000000.0 / SCHED_HZ;
+  arriving = (double) commands * COMMAND_BYTES / SCHED_HZ;
+  owed = 0;
+  ring = partial = dirty = dropped = 0;
+  busy_us = 0;
+
+  while (now_us < SIM_SECONDS * 1000000.0) {
+    if (!sched.runNext()) {
+      // sleep to the next tick
+      now_us = next_tick_us;
+      tick();
+    }
+  }
+
+  printf("%6u %6u %4.0f%%", commands, commands * COMMAND_BYTES, busy_us * 100 / now_us);
+  for (uint8_t i = 0; i < sched.count(); i++) {
+    const task_t *task = sched.task(i);
+    printf(" %6u/%-5u %4u", task->overruns, task->runs, task->worst);
+  }
+  printf(" %8u\n", dropped);
+}
+
+int main()
+{
+  static const uint32_t loads[] = { 0, 100, 500, 1000, 2000, 4000, 6000, 8000 };
+
+  for (int stats = 0; stats < 2; stats++) {
+    printf("%s, %u simulated seconds, overruns/runs and worst ticks per task\n",
+           stats ? "with a stats report every second" : "without stats", SIM_SECONDS);
+    printf("%6s %6s %5s %17s %17s %17s%s %8s\n", "cmd/s", "B/s", "busy", "parse", "render",
+           "animate", stats ? "             stats" : "", "dropped");
+    for (uint32_t i = 0; i < sizeof(loads) / sizeof(loads[0]); i++) {
+      simulate(loads[i], stats);
+    }
+    printf("\n");
+  }
+  return 0;
+}
@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2017 David McKelvie.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "sign_link.h"
+
+#define BEGIN_POLLS     4096    // give up on a sign that never steps
+
+SignLink::SignLink(Transfer transfer, Wait wait, void *context, uint16_t ring)
+  : link(transfer), pause(wait), context(context), ring(ring)
+{
+  unit = ring / STATUS_UNITS;
+  total = 0;
+  consumed = 0;
+  last = 0;
+  pollCount = 0;
+  waitCount = 0;
+}
+
+bool SignLink::begin()
+{
+  // the replies lag a byte, so a step seen now happened at the poll before.
+  // With the sign idle on both sides of it and given time to take each
+  // poll, it has taken exactly a multiple of unit.
+  uint8_t previous = STATUS_BUSY;
+  for (uint32_t i = 0; i < BEGIN_POLLS; i++) {
+    uint8_t nul = 0;
+    uint8_t reply;
+    pause(context);
+    link(context, &nul, &reply, 1);
+    pollCount++;
+
+    bool idle = !(reply & STATUS_BUSY) && !(previous & STATUS_BUSY);
+    if (i > 0 && idle && (reply & STATUS_CONSUMED) != (previous & STATUS_CONSUMED)) {
+      consumed = (reply & STATUS_CONSUMED) * unit;
+      total = consumed + 1;
+      last = reply;
+      return true;
+    }
+    previous = reply;
+  }
+  return false;
+}
+
+// clock bytes out and take the sign's count from the latest reply
+void SignLink::transfer(const uint8_t *data, uint16_t length)
+{
+  uint8_t reply[LINK_CHUNK];
+
+  link(context, data, reply, length);
+  total += length;
+  last = reply[length - 1];
+
+  // the count is known modulo 16 units and no more than a ring behind, so
+  // only one value fits
+  uint32_t sentUnits = total / unit;
+  uint32_t units = sentUnits - ((sentUnits - (last & STATUS_CONSUMED)) & STATUS_CONSUMED);
+  if (units * unit > consumed) {
+    consumed = units * unit;
+  }
+}
+
+void SignLink::poll()
+{
+  static const uint8_t nul = 0;
+
+  pause(context);
+  waitCount++;
+  if (outstanding() < ring) {
+    transfer(&nul, 1);
+    pollCount++;
+  }
+}
+
+// poll until length more bytes leave LINK_RESERVE of the ring for polling.
+// Whole commands only, so the sign never sits on part of one and the count
+// always catches up to within a unit.
+void SignLink::reserve(uint16_t length)
+{
+  while (outstanding() + length > (uint32_t) (ring - LINK_RESERVE)) {
+    poll();
+  }
+}
+
+void SignLink::put(const uint8_t *data, uint16_t length)
+{
+  while (length) {
+    uint16_t count = length < LINK_CHUNK ? length : LINK_CHUNK;
+    transfer(data, count);
+    data += count;
+    length -= count;
+  }
+}
+
+bool SignLink::write(const uint8_t *data, uint16_t length)
+{
+  if (length > maxCommand()) {
+    return false;
+  }
+  reserve(length);
+  put(data, length);
+  return true;
+}
+
+bool SignLink::frame(uint8_t command, const uint8_t *payload, uint16_t length)
+{
+  if (length > maxCommand() - FRAME_OVERHEAD) {
+    return false;
+  }
+
+  uint8_t header[FRAME_HEADER + 1] = {SOH, (uint8_t) length, (uint8_t) (length >> 8), command};
+  uint16_t crc = crc16(header + 1, 3);
+  crc = crc16(payload, length, crc);
+  uint8_t trailer[2] = {(uint8_t) crc, (uint8_t) (crc >> 8)};
+
+  reserve(length + FRAME_OVERHEAD);
+  put(header, sizeof(header));
+  put(payload, length);
+  put(trailer, sizeof(trailer));
+  return true;
+}
+
+frame_result_t SignLink::sync()
+{
+  // the count passing the end of what was sent means the status came after
+  uint32_t end = total;
+  while (consumed < end) {
+    poll();
+  }
+  return (frame_result_t) ((last & STATUS_RESULT_MASK) >> STATUS_RESULT_SHIFT);
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2017 David McKelvie.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __SIGN_LINK_H__
+#define __SIGN_LINK_H__
+#include <stdint.h>
+#include "frame.h"
+
+#define LINK_CHUNK      64      // bytes per transfer, each brings a fresh status
+#define LINK_RESERVE    16      // ring left for polling while the sign catches up
+
+//////////////////////////////////////////////////////////
+///
+///\brief   host side of the SPI link, a reference for sign drivers
+///
+/// Counts every byte clocked out and reads back the status byte the sign
+/// answers with (see frame.h), so it only ever sends what the ring has room
+/// for. The bus can run flat out and nothing is dropped. When there is no
+/// room it calls wait() and polls with NUL bytes, which the parser ignores
+/// between commands, so commands are only started once all of one fits.
+///
+//////////////////////////////////////////////////////////
+class SignLink {
+public:
+  // clock length bytes out on MOSI and collect the replies from MISO
+  typedef void (*Transfer)(void *context, const uint8_t *mosi, uint8_t *miso, uint16_t length);
+  // let the sign get on with it, e.g. sleep for a millisecond
+  typedef void (*Wait)(void *context);
+
+  SignLink(Transfer transfer, Wait wait, void *context, uint16_t ring = 1024);
+
+  //////////////////////////////////////////////////////////
+  ///
+  ///\brief   line the byte count up with the sign's before first use
+  ///
+  /// Polls until the sign is idle and its count has just stepped, so
+  /// the count is known to the byte. Up to one eighth of the ring of polls.
+  ///
+  ///\return  false if the sign never answered
+  ///
+  //////////////////////////////////////////////////////////
+  bool begin();
+
+  //////////////////////////////////////////////////////////
+  ///
+  ///\brief   send one whole v1 command, once there is room for all of it
+  ///
+  ///\return  false if it is longer than maxCommand()
+  ///
+  //////////////////////////////////////////////////////////
+  bool write(const uint8_t *data, uint16_t length);
+
+  // send a v2 frame, false if it is longer than maxCommand()
+  bool frame(uint8_t command, const uint8_t *payload, uint16_t length);
+
+  // longest command the ring is sure to make room for
+  uint16_t maxCommand() { return ring - LINK_RESERVE - unit; }
+
+  //////////////////////////////////////////////////////////
+  ///
+  ///\brief   wait until the sign has taken everything sent so far
+  ///
+  ///\return  result of the last frame sent
+  ///
+  //////////////////////////////////////////////////////////
+  frame_result_t sync();
+
+  uint8_t status() { return last; }
+  uint32_t sent() { return total; }
+  uint32_t polls() { return pollCount; }
+  uint32_t waits() { return waitCount; }
+
+private:
+  void transfer(const uint8_t *data, uint16_t length);
+  void put(const uint8_t *data, uint16_t length);
+  void reserve(uint16_t length);
+  void poll();
+  uint32_t outstanding() { return total - consumed; }
+
+  Transfer link;
+  Wait pause;
+  void *context;
+  uint16_t ring;
+  uint16_t unit;            // ring / STATUS_UNITS
+  uint32_t total;           // bytes clocked out
+  uint32_t consumed;        // bytes the sign has taken, a multiple of unit
+  uint8_t last;             // latest status
+  uint32_t pollCount;
+  uint32_t waitCount;
+};
+
+#endif /* __SIGN_LINK_H__ */
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2017 David McKelvie.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// SignLink against the native build of the firmware, the MISO status
+// keeping a host that streams flat out from overrunning the ring:
+//
+//   g++ -O2 -DNATIVE_HAL -DNATIVE_NO_MAIN -Ilib/NativeHal -Ilib/LEDMatrix -Isrc -Itools
+//       src/*.cpp lib/LEDMatrix/*.cpp lib/NativeHal/*.cpp tools/sign_link.cpp
+//       tools/spi_loopback.cpp -o spi_loopback
+//
+// The sign only gets a pass of loop() every LINE_BYTES bytes on the bus, so
+// the line is faster than it can draw. The same stream is then sent blind.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <NativeHal.h>
+#include <Panel.h>
+#include "buffer.h"
+#include "frame.h"
+#include "sign_link.h"
+
+#define BUFF_LEN        1024    // as in src/main.cpp
+#define WIDTH           192
+#define HEIGHT          32
+#define FRAME_BYTES     (WIDTH * HEIGHT / 8)
+#define CMD_UPLOAD_FRAME 13
+#define CMD_PRINT_LINE  4
+#define LINE_BYTES      2048    // bus bytes per pass of loop()
+#define UPLOADS         24
+
+void setup();
+extern Panel panel;
+extern CircularBuffer<uint8_t, BUFF_LEN> buffer;
+
+static uint32_t lineBytes = 0;
+
+static void transfer(void *context, const uint8_t *mosi, uint8_t *miso, uint16_t length)
+{
+  native_spi_receive(mosi, length, miso);
+  lineBytes += length;
+  while (lineBytes >= LINE_BYTES) {
+    lineBytes -= LINE_BYTES;
+    native_pass();
+  }
+}
+
+static void wait(void *context)
+{
+  native_pass();
+}
+
+static void image(int n, uint8_t *frame)
+{
+  for (int i = 0; i < FRAME_BYTES; i++) {
+    frame[i] = (uint8_t) (i * 7 + n * 13) ^ (n & 1 ? 0xAA : 0x55);
+  }
+}
+
+static bool shows(const uint8_t *frame)
+{
+  for (int y = 0; y < HEIGHT; y++) {
+    for (int x = 0; x < WIDTH; x++) {
+      bool set = frame[y * WIDTH / 8 + x / 8] & (0x80 >> (x % 8));
+      if (set != (panel.pixel(x, y) != 0)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+int main()
+{
+  static uint8_t frame[FRAME_BYTES];
+  const uint8_t line[] = "\x02\x04\x01" "Route 25 Hospital 3 min" "\x03";
+  uint32_t acks = 0;
+
+  setup();
+  native_pass();
+
+  SignLink link(transfer, wait, 0, BUFF_LEN);
+  if (!link.begin()) {
+    printf("no status from the sign\n");
+    return 1;
+  }
+
+  for (int n = 0; n < UPLOADS; n++) {
+    link.write(line, sizeof(line) - 1);
+    image(n, frame);
+    link.frame(CMD_UPLOAD_FRAME, frame, FRAME_BYTES);
+    acks += link.sync() == FRAME_ACK;
+  }
+  for (int i = 0; i < 4; i++) {
+    native_pass();
+  }
+  printf("link:  sent %u, polls %u, waits %u, acks %u of %d, overruns %u, image %s\n",
+         link.sent(), link.polls(), link.waits(), acks, UPLOADS, buffer.overflows(),
+         shows(frame) ? "ok" : "wrong");
+
+  // the same again without looking at MISO, a frame per sync point
+  uint32_t overruns = buffer.overflows();
+  uint32_t sent = 0;
+  for (int n = 0; n < UPLOADS; n++) {
+    uint8_t header[FRAME_HEADER + 1] = {SOH, (uint8_t) FRAME_BYTES, FRAME_BYTES >> 8, CMD_UPLOAD_FRAME};
+    uint16_t crc = crc16(frame, FRAME_BYTES, crc16(header + 1, 3));
+    uint8_t trailer[2] = {(uint8_t) crc, (uint8_t) (crc >> 8)};
+    uint8_t miso[FRAME_BYTES];
+
+    image(n, frame);
+    transfer(0, line, miso, sizeof(line) - 1);
+    transfer(0, header, miso, sizeof(header));
+    transfer(0, frame, miso, FRAME_BYTES);
+    transfer(0, trailer, miso, sizeof(trailer));
+    sent += sizeof(line) - 1 + sizeof(header) + FRAME_BYTES + sizeof(trailer);
+  }
+  for (int i = 0; i < 4; i++) {
+    native_pass();
+  }
+  printf("blind: sent %u, overruns %u, image %s\n", sent, buffer.overflows() - overruns,
+         shows(frame) ? "ok" : "wrong");
+  return 0;
+}
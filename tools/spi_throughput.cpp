@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2017 David McKelvie.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// A blind master streaming text lines and whole frame uploads into the
+// native build of the firmware at a steady SPI clock, a scheduler tick's
+// worth of bytes per pass of loop(), to find the fastest clock the receive
+// ring sustains without an overrun:
+//
+//   g++ -O2 -DNATIVE_HAL -DNATIVE_NO_MAIN -Ilib/NativeHal -Ilib/LEDMatrix -Isrc src/*.cpp lib/LEDMatrix/*.cpp lib/NativeHal/*.cpp tools/spi_throughput.cpp -o spi_throughput
+//
+// The host parses far faster than the target, so this finds where the ring,
+// DMA publishing and parse scheduling give out rather than the CPU. A frame
+// is only parsed once it has all arrived, so a blind sender has to leave
+// room for a parse period's bytes behind the biggest frame. Exits non-zero
+// if anything is dropped at TARGET_SPI_HZ or the last frame sent is not on
+// the panel.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <NativeHal.h>
+#include <Panel.h>
+#include "buffer.h"
+#include "frame.h"
+
+// as in src/main.cpp
+#define BUFF_LEN        1024
+#define SCHED_HZ        1000
+#define WIDTH           192
+#define HEIGHT          32
+#define FRAME_BYTES     (WIDTH * HEIGHT / 8)
+#define CMD_UPLOAD_FRAME 13
+
+#define TARGET_SPI_HZ   2000000     // (BUFF_LEN - a whole upload) bytes per 1ms parse period
+#define SIM_MS          400         // simulated time per clock
+#define SETTLE_PASSES   8
+#define STREAM_MAX      (FRAME_BYTES + 64)
+
+void setup();
+extern Panel panel;
+extern CircularBuffer<uint8_t, BUFF_LEN> buffer;
+
+static uint8_t frame[FRAME_BYTES];
+
+static void image(uint32_t n)
+{
+  for (int i = 0; i < FRAME_BYTES; i++) {
+    frame[i] = (uint8_t) (i * 7 + n * 13) ^ (n & 1 ? 0xAA : 0x55);
+  }
+}
+
+static bool shows()
+{
+  for (int y = 0; y < HEIGHT; y++) {
+    for (int x = 0; x < WIDTH; x++) {
+      bool set = frame[y * WIDTH / 8 + x / 8] & (0x80 >> (x % 8));
+      if (set != (panel.pixel(x, y) != 0)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// the next command of the stream, alternately a text line and a frame
+static uint16_t command(uint32_t n, uint8_t *out)
+{
+  static const uint8_t line[] = "\x02\x04\x01" "Route 25 Hospital 3 min" "\x03";
+
+  if (n % 2 == 0) {
+    memcpy(out, line, sizeof(line) - 1);
+    return sizeof(line) - 1;
+  }
+
+  image(n);
+  uint8_t header[FRAME_HEADER + 1] = {SOH, (uint8_t) FRAME_BYTES, FRAME_BYTES >> 8, CMD_UPLOAD_FRAME};
+  uint16_t crc = crc16(frame, FRAME_BYTES, crc16(header + 1, 3));
+  memcpy(out, header, sizeof(header));
+  memcpy(out + sizeof(header), frame, FRAME_BYTES);
+  out[sizeof(header) + FRAME_BYTES] = (uint8_t) crc;
+  out[sizeof(header) + FRAME_BYTES + 1] = crc >> 8;
+  return sizeof(header) + FRAME_BYTES + 2;
+}
+
+// stream for SIM_MS at hz, returns the overruns it caused
+static uint32_t stream(uint32_t hz, uint32_t *commands)
+{
+  static uint8_t pending[STREAM_MAX];
+  uint32_t overruns = buffer.overflows();
+  uint32_t bytesPerTick = hz / 8 / SCHED_HZ;
+  uint32_t remainder = hz / 8 % SCHED_HZ;
+  uint32_t owed = 0;
+  uint16_t length = 0;
+  uint16_t sent = 0;
+
+  *commands = 0;
+  for (uint32_t ms = 0; ms < SIM_MS; ms++) {
+    uint32_t bytes = bytesPerTick;
+    owed += remainder;
+    if (owed >= SCHED_HZ) {
+      owed -= SCHED_HZ;
+      bytes++;
+    }
+
+    while (bytes) {
+      if (sent == length) {
+        length = command(++*commands, pending);
+        sent = 0;
+      }
+      uint16_t chunk = (uint32_t) (length - sent) < bytes ? length - sent : bytes;
+      native_spi_receive(pending + sent, chunk);
+      sent += chunk;
+      bytes -= chunk;
+    }
+    native_pass();
+  }
+
+  // finish the command in flight so the panel ends on a known frame
+  native_spi_receive(pending + sent, length - sent);
+  if (*commands % 2 == 0) {
+    image(*commands - 1);
+  }
+  for (int i = 0; i < SETTLE_PASSES; i++) {
+    native_pass();
+  }
+  return buffer.overflows() - overruns;
+}
+
+int main()
+{
+  static const uint32_t clocks[] = {
+    1000000, TARGET_SPI_HZ, 3000000, 4500000, 6000000, 9000000, 12000000, 18000000
+  };
+  uint32_t fastest = 0;
+  bool clean = true;
+  bool ok = true;
+
+  setup();
+  native_pass();
+
+  printf("%9s %9s %9s %9s %6s\n", "SPI Hz", "bytes/ms", "commands", "overruns", "image");
+  for (uint32_t i = 0; i < sizeof(clocks) / sizeof(clocks[0]); i++) {
+    uint32_t commands;
+    uint32_t overruns = stream(clocks[i], &commands);
+    bool same = shows();
+
+    printf("%9u %9u %9u %9u %6s\n", clocks[i], clocks[i] / 8 / SCHED_HZ, commands, overruns,
+           same ? "ok" : "wrong");
+    clean = clean && !overruns && same;
+    if (clean) {
+      fastest = clocks[i];
+    }
+    if (clocks[i] == TARGET_SPI_HZ && !clean) {
+      ok = false;
+    }
+  }
+
+  printf("fastest sustained without loss: %u Hz, target %u Hz %s\n", fastest, TARGET_SPI_HZ,
+         ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,256 @@
+/*
+ * Copyright (C) 2017 David McKelvie.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// StaticMatrix against a generic LEDMatrix given the same geometry at run
+// time. Both draw the same random points, clear, scroll viewports and take
+// tile maps, and after each update() the port words in their scan buffers
+// and their canvases must match, for the fixed encoder with its constant
+// stride drawPoint(), clear() and viewport lookup and for the tile map walk
+// StaticMatrix falls back to. Runs on the host, exits non-zero on a failure:
+//
+//   g++ -O2 -DNATIVE_HAL -DNATIVE_NO_MAIN -Ilib/NativeHal -Ilib/LEDMatrix lib/LEDMatrix/*.cpp lib/NativeHal/*.cpp tools/static_test.cpp -o static_test
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <Arduino.h>
+#include "LEDMatrix.h"
+#include "NativeHal.h"
+#include "StaticMatrix.h"
+
+// as wired in src/main.cpp
+#define PIN_A           PA13
+#define PIN_B           PA12
+#define PIN_C           PA11
+#define PIN_D           PA8
+#define PIN_OE          PB0
+#define PIN_LAT         PB14
+#define PIN_CLK         PB15
+#define PIN_R1          PB9
+#define PIN_R2          PB5
+
+#define MAX_CANVAS      (384 * 32 / 8)
+#define MAX_WORDS       (MAX_CHAIN * 16)
+#define POINTS          2000
+
+static uint8_t fixedbuf[MAX_CANVAS];
+static uint8_t genericbuf[MAX_CANVAS];
+static uint16_t fixedscan[MAX_WORDS];
+static uint16_t genericscan[MAX_WORDS];
+
+static int failures = 0;
+
+// native_pass() calls loop(), there is no firmware here
+void setup()
+{
+}
+
+void loop()
+{
+}
+
+static void check(bool ok, const char *what)
+{
+  printf("%-48s %s\n", what, ok ? "ok" : "FAILED");
+  failures += !ok;
+}
+
+template <typename Matrix>
+class Pair {
+public:
+  Pair(const char *name, Matrix &fixed)
+    : name(name), fixed(fixed), generic(PIN_A, PIN_B, PIN_C, PIN_D, PIN_OE, PIN_R1, PIN_R2, PIN_LAT, PIN_CLK)
+  {
+  }
+
+  // the generic matrix laid out as StaticMatrix::begin() lays out its own
+  void begin()
+  {
+    MatrixTile tiles[Matrix::Lines];
+    for (uint8_t line = 0; line < Matrix::Lines; line++) {
+      tiles[line].x = 0;
+      tiles[line].y = (Matrix::Lines - 1 - line) * moduleHeight();
+      tiles[line].rotation = TILE_ROTATE_0;
+    }
+
+    memset(fixedbuf, 0, sizeof(fixedbuf));
+    memset(genericbuf, 0, sizeof(genericbuf));
+    fixed.begin(fixedbuf);
+    generic.begin(genericbuf, width(), height());
+    generic.setCanvas(Matrix::CanvasStride * 8, canvasHeight());
+    generic.setTileMap(tiles, Matrix::Lines, width(), moduleHeight(), fixed.rows());
+    fixed.reverse();
+    generic.reverse();
+    fixed.setScanBuffer(fixedscan);
+    generic.setScanBuffer(genericscan);
+    fixed.update();
+    generic.update();
+    compare("begin");
+  }
+
+  void points(const char *what)
+  {
+    for (uint16_t i = 0; i < POINTS; i++) {
+      uint16_t x = rand() % (Matrix::CanvasStride * 8);
+      uint16_t y = rand() % canvasHeight();
+      uint8_t pixel = rand() & 1;
+      fixed.drawPoint(x, y, pixel);
+      generic.drawPoint(x, y, pixel);
+    }
+    fixed.update();
+    generic.update();
+    compare(what);
+  }
+
+  void clear()
+  {
+    fixed.clear();
+    generic.clear();
+    fixed.update();
+    generic.update();
+    compare("clear");
+  }
+
+  void viewport(uint8_t zone, uint16_t top, uint16_t rows, uint16_t x, uint16_t y, const char *what)
+  {
+    fixed.setViewport(zone, top, rows, x, y);
+    generic.setViewport(zone, top, rows, x, y);
+    fixed.update();
+    generic.update();
+    compare(what);
+  }
+
+  void scroll(uint8_t zone, int16_t dx, int16_t dy, const char *what)
+  {
+    fixed.scrollViewport(zone, dx, dy);
+    generic.scrollViewport(zone, dx, dy);
+    fixed.update();
+    generic.update();
+    compare(what);
+  }
+
+  void tileMap(const MatrixTile *tiles, uint8_t count, uint16_t moduleWidth, const char *what)
+  {
+    bool taken = fixed.setTileMap(tiles, count, moduleWidth);
+    bool genericTaken = generic.setTileMap(tiles, count, moduleWidth, moduleHeight(), fixed.rows());
+    fixed.update();
+    generic.update();
+    if (!taken || !genericTaken) {
+      report(what, false);
+      return;
+    }
+    compare(what);
+  }
+
+private:
+  static uint16_t width() { return Matrix::Stride * 8; }
+  static uint16_t height() { return Matrix::DisplayBytes / Matrix::Stride; }
+  static uint16_t canvasHeight() { return Matrix::CanvasBytes / Matrix::CanvasStride; }
+  static uint8_t moduleHeight() { return height() / Matrix::Lines; }
+
+  void compare(const char *what)
+  {
+    uint32_t words = (uint32_t) fixed.rows() * fixed.columns();
+    report(what, fixed.columns() == generic.columns() && fixed.rows() == generic.rows() &&
+           !fixed.dirtyRows() && !generic.dirtyRows() &&
+           !memcmp(fixedbuf, genericbuf, Matrix::CanvasBytes) &&
+           !memcmp(fixedscan, genericscan, words * sizeof(uint16_t)));
+  }
+
+  void report(const char *what, bool ok)
+  {
+    char line[96];
+    snprintf(line, sizeof(line), "%s: %s", name, what);
+    check(ok, line);
+  }
+
+  const char *name;
+  Matrix &fixed;
+  LEDMatrix generic;
+};
+
+// as src/main.cpp with the default configuration, a canvas three panels wide
+static void testWide()
+{
+  typedef StaticMatrix<128, 32, 16, 32, 384> Matrix;
+  static Matrix fixed(PIN_A, PIN_B, PIN_C, PIN_D, PIN_OE, PIN_R1, PIN_R2, PIN_LAT, PIN_CLK);
+  static const MatrixTile swapped[] = { {64, 0, TILE_ROTATE_180}, {0, 0, TILE_ROTATE_0} };
+  Pair<Matrix> pair("128x32 on 384x32", fixed);
+
+  pair.begin();
+  pair.points("points");
+  pair.viewport(0, 0, 0, 200, 0, "zone 0 from x 200");
+  pair.scroll(0, 190, 0, "zone 0 wrapping the right edge");
+  pair.viewport(1, 8, 8, 13, 8, "zone 1 over rows 8 to 15");
+  pair.scroll(1, -20, 3, "zone 1 scrolled back and down");
+  pair.points("points under the zones");
+  pair.viewport(1, 0, 0, 0, 0, "zone 1 removed");
+  pair.clear();
+  pair.points("points after clear");
+  pair.tileMap(swapped, 2, 64, "modules swapped, one turned 180");
+  pair.points("points on the tile map");
+  pair.scroll(0, 7, 5, "zone 0 scrolled on the tile map");
+}
+
+// four rows of 1/8 scan modules 16 rows high, a canvas taller than the panel
+static void testTall()
+{
+  typedef StaticMatrix<64, 64, 8, 16, 64, 96> Matrix;
+  static Matrix fixed(PIN_A, PIN_B, PIN_C, PIN_D, PIN_OE, PIN_R1, PIN_R2, PIN_LAT, PIN_CLK);
+  static const MatrixTile serpentine[] = {
+    {0, 0, TILE_ROTATE_0}, {0, 16, TILE_ROTATE_180}, {0, 32, TILE_ROTATE_0}, {0, 48, TILE_ROTATE_180}
+  };
+  Pair<Matrix> pair("64x64 of 1/8 scan on 64x96", fixed);
+
+  pair.begin();
+  pair.points("points");
+  pair.scroll(0, 0, 40, "zone 0 scrolled down the canvas");
+  pair.viewport(2, 48, 16, 8, 80, "zone 2 over the bottom module");
+  pair.scroll(2, 3, -9, "zone 2 wrapping its own rows");
+  pair.points("points under the zones");
+  pair.clear();
+  pair.tileMap(serpentine, 4, 64, "serpentine tile map");
+  pair.points("points on the tile map");
+}
+
+// 1/4 scan modules with two module rows a scan row and half
+static void testBlocks()
+{
+  typedef StaticMatrix<64, 32, 4, 16> Matrix;
+  static Matrix fixed(PIN_A, PIN_B, PIN_C, PIN_D, PIN_OE, PIN_R1, PIN_R2, PIN_LAT, PIN_CLK);
+  static const MatrixTile turned[] = { {0, 16, TILE_ROTATE_180}, {0, 0, TILE_ROTATE_180} };
+  Pair<Matrix> pair("64x32 of 1/4 scan", fixed);
+
+  pair.begin();
+  pair.points("points");
+  pair.viewport(1, 4, 20, 9, 0, "zone 1 across both modules");
+  pair.scroll(0, -1, 1, "zone 0 scrolled a pixel");
+  pair.points("points under the zones");
+  pair.clear();
+  pair.tileMap(turned, 2, 64, "modules turned 180");
+  pair.points("points on the tile map");
+}
+
+int main()
+{
+  srand(1);
+  testWide();
+  testTall();
+  testBlocks();
+
+  printf("%d failed\n", failures);
+  return failures ? 1 : 0;
+}
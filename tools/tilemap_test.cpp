@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2017 David McKelvie.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Tile maps through the scan engine to the simulated Panel in lib/NativeHal.
+// Every bit the panel latches is traced back through the wiring setTileMap()
+// documents, module by module from the far end of the chain, to the pixel
+// it shows on the logical display, for turned modules, a serpentine chain
+// and 1/8 scan modules. Then the maps a scan row cannot shift are refused.
+// Runs on the host, exits non-zero on the first failure:
+//
+//   g++ -O2 -DNATIVE_HAL -DNATIVE_NO_MAIN -Ilib/NativeHal -Ilib/LEDMatrix lib/LEDMatrix/*.cpp lib/NativeHal/*.cpp tools/tilemap_test.cpp -o tilemap_test
+
+#include <stdio.h>
+#include <HardwareTimer.h>
+#include "LEDMatrix.h"
+#include "NativeHal.h"
+#include "Panel.h"
+#include "ScanEngine.h"
+
+// as wired in src/main.cpp
+#define PIN_A           PA13
+#define PIN_B           PA12
+#define PIN_C           PA11
+#define PIN_D           PA8
+#define PIN_OE          PB0
+#define PIN_LAT         PB14
+#define PIN_CLK         PB15
+#define PIN_R1          PB9
+#define PIN_R2          PB5
+
+#define MAX_WIDTH       128
+#define MAX_HEIGHT      64
+#define TICKS           12
+#define MAX_TICKS       1000000     // TIM1 updates before giving up on a frame
+
+struct Layout {
+  const char *name;
+  uint16_t width, height;
+  uint16_t moduleWidth, moduleHeight;
+  uint8_t scanRows;
+  uint8_t count;
+  MatrixTile tiles[4];
+};
+
+static const Layout layouts[] = {
+  // two 64x32 modules standing on end, turned opposite ways
+  { "64x64 of modules turned 90 and 270", 64, 64, 64, 32, 16, 2,
+    { {0, 0, TILE_ROTATE_90}, {32, 0, TILE_ROTATE_270} } },
+  // a row of three, the middle one upside down
+  { "192x32 middle module turned 180", 192, 32, 64, 32, 16, 3,
+    { {0, 0, TILE_ROTATE_0}, {64, 0, TILE_ROTATE_180}, {128, 0, TILE_ROTATE_0} } },
+  // two rows, the chain coming back along the second upside down
+  { "128x64 serpentine chain", 128, 64, 64, 32, 16, 4,
+    { {0, 0, TILE_ROTATE_0}, {64, 0, TILE_ROTATE_0},
+      {64, 32, TILE_ROTATE_180}, {0, 32, TILE_ROTATE_180} } },
+  // 1/8 scan, each scan row lighting two module rows a half
+  { "128x32 of 1/8 scan modules", 128, 32, 64, 32, 8, 2,
+    { {64, 0, TILE_ROTATE_0}, {0, 0, TILE_ROTATE_0} } },
+  // 1/8 scan stacked and turned, 256 pixels a scan row
+  { "64x64 of 1/8 scan modules, serpentine", 64, 64, 64, 32, 8, 2,
+    { {0, 0, TILE_ROTATE_0}, {0, 32, TILE_ROTATE_180} } },
+};
+
+static uint8_t displaybuf[MAX_WIDTH * MAX_HEIGHT / 8];
+static uint16_t scanbuf[MAX_CHAIN * 16];
+
+static LEDMatrix matrix(PIN_A, PIN_B, PIN_C, PIN_D, PIN_OE, PIN_R1, PIN_R2, PIN_LAT, PIN_CLK);
+static ScanEngine engine(Timer1, Timer3);
+static int failures = 0;
+
+// native_pass() calls loop(), there is no firmware here
+void setup()
+{
+}
+
+void loop()
+{
+}
+
+static void check(bool ok, const char *what)
+{
+  printf("%-48s %s\n", what, ok ? "ok" : "FAILED");
+  failures += !ok;
+}
+
+// an irregular pattern, so any mapping but the right one shows
+static bool lit(uint16_t x, uint16_t y)
+{
+  return (x * 5 + y * 11 + x * y) % 7 < 3;
+}
+
+// where module pixel x, y of an upright width by height module lands once
+// the module is turned a quarter clockwise at a time
+static void turn(uint8_t quarters, uint16_t width, uint16_t height, uint16_t *x, uint16_t *y)
+{
+  while (quarters--) {
+    uint16_t nx = height - 1 - *y;
+    *y = *x;
+    *x = nx;
+    uint16_t swap = width;
+    width = height;
+    height = swap;
+  }
+}
+
+// the logical pixel the panel shows at chain column c of scan row r, in
+// the upper or lower half: the module furthest from the controller is
+// shifted first, and within a module the module rows a scan row lights are
+// shifted top one first, each left to right along the upright module
+static void logical(const Layout &l, uint16_t c, uint8_t r, uint8_t lower, uint16_t *x, uint16_t *y)
+{
+  uint16_t blocks = l.moduleHeight / (2 * l.scanRows);
+  uint16_t perModule = l.moduleWidth * blocks;
+  const MatrixTile &tile = l.tiles[l.count - 1 - c / perModule];
+  uint16_t block = c % perModule / l.moduleWidth;
+
+  *x = c % l.moduleWidth;
+  *y = lower * l.moduleHeight / 2 + block * l.scanRows + r;
+  turn(tile.rotation, l.moduleWidth, l.moduleHeight, x, y);
+  *x += tile.x;
+  *y += tile.y;
+}
+
+static bool runFrames(Panel &panel, uint32_t frames)
+{
+  uint32_t target = panel.frames() + frames;
+  for (uint32_t tick = 0; tick < MAX_TICKS; tick++) {
+    if (panel.frames() >= target) {
+      return true;
+    }
+    if (!native_timer_tick(1)) {
+      return false;
+    }
+  }
+  return false;
+}
+
+static void testLayout(const Layout &l)
+{
+  uint16_t columns = l.count * l.moduleWidth * (l.moduleHeight / (2 * l.scanRows));
+  Panel panel(PIN_A, PIN_B, PIN_C, PIN_D, PIN_OE, PIN_LAT, PIN_CLK,
+              PIN_R1, PIN_R2, PANEL_NO_PIN, PANEL_NO_PIN, PANEL_NO_PIN, PANEL_NO_PIN,
+              columns, l.scanRows);
+  char what[96];
+
+  matrix.begin(displaybuf, l.width, l.height);
+  matrix.reverse();
+  panel.setActiveLow(matrix.isReversed());
+
+  snprintf(what, sizeof(what), "%s: map", l.name);
+  check(matrix.setTileMap(l.tiles, l.count, l.moduleWidth, l.moduleHeight, l.scanRows) &&
+        matrix.columns() == columns && matrix.rows() == l.scanRows, what);
+
+  matrix.setScanBuffer(scanbuf);
+  matrix.clear();
+  for (uint16_t y = 0; y < l.height; y++) {
+    for (uint16_t x = 0; x < l.width; x++) {
+      matrix.drawPoint(x, y, lit(x, y));
+    }
+  }
+  matrix.update();
+
+  bool running = engine.begin(&matrix, TICKS);
+  engine.start();
+  running = running && runFrames(panel, 2);
+  engine.stop();
+  while (native_timer_tick(1)) {
+  }
+  snprintf(what, sizeof(what), "%s: refreshed", l.name);
+  check(running, what);
+
+  // every panel bit once, and so every logical pixel once
+  bool same = true;
+  uint32_t seen = 0;
+  for (uint8_t lower = 0; lower < 2; lower++) {
+    for (uint8_t r = 0; r < l.scanRows; r++) {
+      for (uint16_t c = 0; c < columns; c++) {
+        uint16_t x, y;
+        logical(l, c, r, lower, &x, &y);
+        if (x >= l.width || y >= l.height) {
+          same = false;
+          continue;
+        }
+        same = same && lit(x, y) == (panel.pixel(c, r + lower * l.scanRows) != 0);
+        seen++;
+      }
+    }
+  }
+  snprintf(what, sizeof(what), "%s: image", l.name);
+  check(same && seen == (uint32_t) l.width * l.height, what);
+}
+
+static void testRefused()
+{
+  static const MatrixTile three[] = { {0, 0, TILE_ROTATE_0}, {64, 0, TILE_ROTATE_0}, {128, 0, TILE_ROTATE_0} };
+  static const MatrixTile two[] = { {0, 0, TILE_ROTATE_0}, {64, 0, TILE_ROTATE_0} };
+
+  // three 1/8 scan modules shift 384 pixels a scan row
+  matrix.begin(displaybuf, 192, 32);
+  check(matrix.setTileMap(two, 2, 64, 32, 16), "refused: 1/16 scan map taken first");
+  check(!matrix.setTileMap(three, 3, 64, 32, 8), "refused: 384 pixel 1/8 scan chain");
+  check(matrix.columns() == 128 && matrix.rows() == 16, "refused: keeps the map there was");
+
+  // nor more runs than there are segments, narrow 1/2 scan modules
+  check(!matrix.setTileMap(two, 2, 8, 64, 2), "refused: 32 runs of 8 pixels");
+}
+
+int main()
+{
+  for (uint32_t i = 0; i < sizeof(layouts) / sizeof(layouts[0]); i++) {
+    testLayout(layouts[i]);
+  }
+  testRefused();
+
+  printf("%d failed\n", failures);
+  return failures ? 1 : 0;
+}